@@ -1,603 +1,587 @@
 #include "Cell.h"
 #include "Math/UnrealMathUtility.h"
-#include <Serialization/BulkData.h>
 #include <TextureResource.h>
+#include <RenderingThread.h>
+#include <RHI.h>
 #include <Engine/Engine.h>
-#include <type_traits>
+#include <Async/ParallelFor.h>
+#include <algorithm>
+#include "Simulation/Lenses.h"
+#include "Simulation/Parallel.h"
+
+
+// rows of the lens textures drawn per ParallelFor task
+constexpr int32 gLenseRowBlock = 16;
+
+// "stat CellFactory", the cycle stats also show up as named events in Unreal Insights
+DECLARE_STATS_GROUP(TEXT("CellFactory"), STATGROUP_CellFactory, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Tick"), STAT_CellTick, STATGROUP_CellFactory);
+DECLARE_CYCLE_STAT(TEXT("Lenses"), STAT_CellLenses, STATGROUP_CellFactory);
+
+// phases of the simulation's last tick, wherever it ran
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Integrate ms"), STAT_CellIntegrate, STATGROUP_CellFactory);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Interpret ms"), STAT_CellInterpret, STATGROUP_CellFactory);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Resolve ms"), STAT_CellResolve, STATGROUP_CellFactory);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Compact ms"), STAT_CellCompact, STATGROUP_CellFactory);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Repopulate ms"), STAT_CellRepopulate, STATGROUP_CellFactory);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Checksum ms"), STAT_CellChecksum, STATGROUP_CellFactory);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Genes run"), STAT_CellGenes, STATGROUP_CellFactory);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Mutations"), STAT_CellMutations, STATGROUP_CellFactory);
+
+Vec2i ACellActor::GetLenseSize(ELense lense, const Vec2i & world_size)
+{
+	// a texture row holds the cells of one X, the texture is Size.Y wide and Size.X tall
+	// the age lens is a strip of the environment along the depth
+	return lense == ELense::Age ? Vec2i(world_size.Y, 1) : Vec2i(world_size.Y, world_size.X);
+}
+
+UTexture2D * ACellActor::GenerateTexture(ELense lense)
+{
+	UpdateLenses(&lense, 1);
 
+	return LenseTextures[static_cast<int32>(lense)];
+}
 
-UTexture2D * ACellActor::GenerateTexture(ELense lense) const
+TArray<UTexture2D *> ACellActor::GenerateTextures(const TArray<ELense> & lenses)
 {
-	UTexture2D * generated;
-	if (lense == ELense::Age)
-	{
-		generated = UTexture2D::CreateTransient(gSize.Y, 1);
-	}
-	else
+	UpdateLenses(lenses.GetData(), lenses.Num());
+
+	TArray<UTexture2D *> textures;
+	textures.Reserve(lenses.Num());
+	for (auto lense : lenses)
 	{
-		generated = UTexture2D::CreateTransient(gSize.X, gSize.Y);
+		textures.Add(LenseTextures[static_cast<int32>(lense)]);
 	}
-	//generated->Filter = TextureFilter::TF_Nearest;
-	generated->UpdateResource();
 
-	//if (mArray.Num() > 0)
+	return textures;
+}
+
+void ACellActor::UpdateLenses(const ELense * lenses, int32 count)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CellLenses);
+
+	// the simulation thread publishes copies, without it the world is read in place
+	const LenseSource source = View ? GetLenseSource(*View) : GetLenseSource(Simulation, LenseLight, LenseChemo);
+
+	// bit per ELense: grid lenses to redraw and lenses whose texture was just created
+	uint32 grid_lenses = 0;
+	uint32 full_lenses = 0;
+
+	for (int32 k = 0; k < count; ++k)
 	{
-		FTexture2DMipMap& GeneratedMip = generated->PlatformData->Mips[0];
-		void * GeneratedData = GeneratedMip.BulkData.Lock(LOCK_READ_WRITE);
+		const auto lense = lenses[k];
+		const int32 lense_index = static_cast<int32>(lense);
+		if (lense_index >= LenseTextures.Num())
+		{
+			LenseTextures.SetNumZeroed(lense_index + 1);
+			LenseStaging.SetNum(lense_index + 1);
+			LenseStamps.SetNumZeroed(lense_index + 1);
+		}
 
-		const int32 buffer_count = GeneratedMip.BulkData.GetElementCount() * GeneratedMip.BulkData.GetElementSize();
+		// textures of a world that was reset to another size are made again
+		const Vec2i size = GetLenseSize(lense, source.Size);
+		auto & generated = LenseTextures[lense_index];
+		if (!generated || generated->GetSizeX() != size.X || generated->GetSizeY() != size.Y)
+		{
+			generated = UTexture2D::CreateTransient(size.X, size.Y);
+			//generated->Filter = TextureFilter::TF_Nearest;
+			generated->UpdateResource();
 
-		TArray<uint8> pData;
-		pData.SetNum(buffer_count);
+			LenseStaging[lense_index].SetNumZeroed(size.Capacity());
+			full_lenses |= 1u << lense_index;
+		}
 
-		static std::array<FColor, 6> colors = {FColor::Silver, FColor::Green, FColor::Blue, FColor::Purple, FColor::Red, FColor::Yellow};
+		if (lense == ELense::Age)
+		{
+			// the environment strip is tiny and changes with time, it is redrawn on every call
+			FillAgePixels(source, 0, size.X, LenseStaging[lense_index].GetData());
+			full_lenses |= 1u << lense_index;
+		}
+		else
+		{
+			grid_lenses |= 1u << lense_index;
+		}
+	}
 
-		for (int j = 0; j < buffer_count; j += 4)
+	// One sweep over the grid in blocks of rows, every requested lens of a row is drawn
+	// while its cells are still in cache
+	const int32 rows = source.Size.X;
+	const int32 row_length = source.Size.Y;
+	const int32 blocks = (rows + gLenseRowBlock - 1) / gLenseRowBlock;
+	ParallelFor(blocks, [&](int32 block)
+	{
+		const int32 end_row = FMath::Min((block + 1) * gLenseRowBlock, rows);
+		for (int32 row = block * gLenseRowBlock; row < end_row; ++row)
 		{
-			uint8 v = 0;
-			size_t cache = 0;
-			switch (lense)
+			for (uint32 mask = grid_lenses; mask != 0; mask &= mask - 1)
 			{
-			case ELense::Feed:
-				pData[j] = colors[mArray[j / 4].FeedType].B;
-				pData[j + 1] = colors[mArray[j / 4].FeedType].G;
-				pData[j + 2] = colors[mArray[j / 4].FeedType].R;
-				break;
-			case ELense::Energy:
-				pData[j] = (mArray[j / 4].IsDead() && mArray[j / 4].Energy > 0) * 255;
-				pData[j + 1] = mArray[j / 4].IsDead() * 255;
-				pData[j + 2] = (FMath::Clamp(mArray[j / 4].Energy, 0.f, 100.f) / 100.f) * 255;
-				break;
-			case ELense::Age:
-			{
-				pData[j] = GetChemo(IndexToCell(j / 4).Y) * 127;// *0.5f * 3.f + 1.f * 51; //B
-				pData[j + 1] = GetLight(IndexToCell(j / 4).Y) * 127; //G
-				pData[j + 2] = GetLight(IndexToCell(j / 4).Y) * 127; //R
-			}
-			break;
-			case ELense::Genome:
-				if (mArray[j / 4].IsDead())
+				const int32 lense_index = FMath::CountTrailingZeros(mask);
+				if (!(full_lenses & (1u << lense_index)) && source.RowStamp[row] <= LenseStamps[lense_index])
 				{
-					pData[j] = 0; //B
-					pData[j + 1] = 0; //G
-					pData[j + 2] = 0; //R
 					continue;
 				}
-				std::hash<uint8> hasher;
-				cache = hasher(mArray[j / 4].GenomeSum);
-				pData[j] = cache % 255;
-				pData[j + 1] = (cache / 255) % 255;
-				pData[j + 2] = (cache / 255 / 255) % 255;
-				break;
-			default:
-				pData[j] = 0; //B
-				pData[j + 1] = 0; //G
-				pData[j + 2] = 0; //R
-				break;
+
+				const int32 first = row * row_length;
+				uint32 * out = LenseStaging[lense_index].GetData() + first;
+
+				switch (static_cast<ELense>(lense_index))
+				{
+				case ELense::Energy:
+					FillEnergyPixels(source, first, row_length, out);
+					break;
+				case ELense::Genome:
+					FillGenomePixels(source, first, row_length, out);
+					break;
+				case ELense::Feed:
+					FillFeedPixels(source, first, row_length, out);
+					break;
+				default:
+					break;
+				}
 			}
 		}
+	});
+
+	// the oldest upload of the ring, the render thread is usually long done with it
+	FLenseUpload & upload = Uploads[NextUpload];
+	upload.Fence.Wait();
+	upload.Pixels.Reset();
+	upload.Regions.Reset();
+
+	for (int32 k = 0; k < count; ++k)
+	{
+		const int32 lense_index = static_cast<int32>(lenses[k]);
+		const bool full = (full_lenses & (1u << lense_index)) != 0;
+		const Vec2i size = GetLenseSize(lenses[k], source.Size);
+		auto * resource = static_cast<FTexture2DResource *>(LenseTextures[lense_index]->Resource);
+
+		// runs of changed rows, each one a region whose rows follow the previous region's in Pixels
+		const int32 first_region = upload.Regions.Num();
+		for (int32 row = 0; row < size.Y; ++row)
+		{
+			if (!full && source.RowStamp[row] <= LenseStamps[lense_index])
+			{
+				continue;
+			}
 
-		FMemory::Memcpy(GeneratedData, &pData[0], pData.Num() * sizeof(uint8));
+			if (upload.Regions.Num() > first_region && static_cast<int32>(upload.Regions.Last().Region.DestY + upload.Regions.Last().Region.Height) == row)
+			{
+				++upload.Regions.Last().Region.Height;
+			}
+			else
+			{
+				upload.Regions.Add({ resource, FUpdateTextureRegion2D(0, row, 0, 0, size.X, 1), static_cast<uint32>(size.X * 4), upload.Pixels.Num() });
+			}
+			upload.Pixels.Append(LenseStaging[lense_index].GetData() + row * size.X, size.X);
+		}
+		LenseStamps[lense_index] = source.Stamp;
+	}
 
-		GeneratedMip.BulkData.Unlock();
-		generated->UpdateResource();
+	if (upload.Regions.Num() == 0)
+	{
+		return;
 	}
 
-	return generated;
+	// the textures are written between frames on the render thread, the game thread goes
+	// on painting into LenseStaging meanwhile
+	const FLenseUpload * pending = &upload;
+	ENQUEUE_RENDER_COMMAND(UpdateCellLenses)([pending](FRHICommandListImmediate & RHICmdList)
+	{
+		const uint8 * pixels = reinterpret_cast<const uint8 *>(pending->Pixels.GetData());
+		for (const auto & region : pending->Regions)
+		{
+			RHIUpdateTexture2D(region.Resource->GetTexture2DRHI(), 0, region.Region, region.Pitch, pixels + region.Offset * sizeof(uint32));
+		}
+	});
+	upload.Fence.BeginFence();
+	NextUpload = (NextUpload + 1) % LenseUploads;
 }
 
-void ACellActor::Mutate(Cell & cell, bool rehash)
+bool ACellActor::IsReadyForFinishDestroy()
 {
-	cell.Genome[rstream.RandHelper(gGenomeSize)] = rstream.RandHelper(std::numeric_limits<GeneType>::max());
-	if (rehash)
+	bool uploaded = true;
+	for (const auto & upload : Uploads)
 	{
-		cell.SetGenome(cell.Genome);
+		uploaded = uploaded && upload.Fence.IsFenceComplete();
 	}
-	else
+	return Super::IsReadyForFinishDestroy() && uploaded;
+}
+
+void ACellActor::Mutate(CellRef cell, bool rehash)
+{
+	if (Thread)
 	{
-		++cell.GeneDeviation;
+		Thread->Execute([&](CellSimulation & simulation)
+		{
+			simulation.Mutate(cell, rehash);
+		});
+		return;
 	}
+
+	Simulation.Mutate(cell, rehash);
 }
 
 float ACellActor::GetTime() const
 {
-	return time_ticks / 1000.f;
+	return View ? View->Time : Simulation.GetTime();
 }
 
 float ACellActor::GetLight(int32 depth) const
 {
-	return (FMath::Abs((FMath::Cos(GetTime()) + FMath::Sin(GetTime() * 4) + 2) / 4.f) * SunMax * (1 - (depth / float(gSize.Y)))) + SunMin;
+	if (View)
+	{
+		// Simulation belongs to the simulation thread, depths past the view have none
+		return depth >= 0 && depth < static_cast<int32>(View->Light.size()) ? View->Light[depth] : 0.f;
+	}
+	return Simulation.GetLight(depth);
 }
 
 float ACellActor::GetChemo(int32 depth) const
 {
-	auto chemenergy = (depth / float(gSize.Y)) * MinMax + MinMin;
-	return chemenergy;
+	if (View)
+	{
+		return depth >= 0 && depth < static_cast<int32>(View->Chemo.size()) ? View->Chemo[depth] : 0.f;
+	}
+	return Simulation.GetChemo(depth);
 }
 
-void ACellActor::Tick(float DeltaSeconds)
+void ACellActor::ApplyParameters(SimulationParameters & parameters) const
 {
-	Super::Tick(DeltaSeconds);
+	parameters.SunMin = SunMin;
+	parameters.SunMax = SunMax;
+	parameters.MinMax = MinMax;
+	parameters.MinMin = MinMin;
+	parameters.MutationRatio = MutationRatio;
+	parameters.ParallelTick = ParallelTick;
+	parameters.TileSize = TileSize;
+	parameters.SortActiveCells = SortActiveCells;
+	parameters.Deterministic = Deterministic;
+	parameters.ChecksumInterval = ChecksumInterval;
+	parameters.FreeControlGenes = FreeControlGenes;
+	parameters.Topology = static_cast<ETopology>(Topology);
+}
 
-	auto tick1 = FPlatformTime::Seconds();
-	TickUpdated = 0;
+void ACellActor::ReadParameters(const SimulationParameters & parameters)
+{
+	SunMin = parameters.SunMin;
+	SunMax = parameters.SunMax;
+	MinMax = parameters.MinMax;
+	MinMin = parameters.MinMin;
+	MutationRatio = parameters.MutationRatio;
+	ParallelTick = parameters.ParallelTick;
+	TileSize = parameters.TileSize;
+	SortActiveCells = parameters.SortActiveCells;
+	WorldSize = FIntPoint(parameters.WorldSize.X, parameters.WorldSize.Y);
+	UseHugePages = parameters.HugePages;
+	Deterministic = parameters.Deterministic;
+	ChecksumInterval = parameters.ChecksumInterval;
+	FreeControlGenes = parameters.FreeControlGenes;
+	Topology = static_cast<ECellTopology>(parameters.Topology);
+}
 
-	for (int32 iter = 0; iter < Acceleration; ++iter)
+void ACellActor::ReadStats(const PopulationStats & stats)
+{
+	Population.Live = stats.Live;
+	Population.Decaying = stats.Decaying;
+	Population.LiveEnergy = stats.LiveEnergy;
+	Population.DecayingEnergy = stats.DecayingEnergy;
+	Population.Species = stats.Species;
+
+	Population.FeedTypes.SetNum(PopulationStats::FeedTypes);
+	for (int32 k = 0; k < PopulationStats::FeedTypes; ++k)
 	{
-		++time_ticks;
-
-		auto updated = 0;
-
-		for (int32 j = 0; j < gSize.Y; ++j)
-		{
-			auto photoenergy = GetLight(j);
-			auto chemenergy = GetChemo(j);
-			for (int32 i = 0; i < gSize.X; ++i)
-			{
-				auto self_index = CellToIndex({ i, j });
-
-				//if (!mArray[self_index].IsDead())
-				{
-					auto & cell = mArray[self_index];
-
-					cell.accumulated_delta += cell.Speed;
-					cell.Speed *= 0.9;
-
-					if (!cell.IsDead())
-					{
-						++updated;
-						++TickUpdated;
-
-						//bool jumped = false;
-					//single_jump:
-						const auto command1 = cell.Genome[cell.Counter % gGenomeSize];
-						//if (jumped && (command1 == EGene::Counter || command1 == EGene::DetectEnergy || command1 == EGene::DetectFriend || command1 == EGene::DetectOther))
-						//{
-						//	goto double_jump;
-						//}
-
-						const auto i_param1 = cell.Genome[(cell.Counter + 1) % gGenomeSize];
-						const auto param1 = i_param1 / float(std::numeric_limits<GeneType>::max());
-						const auto i_param2 = cell.Genome[(cell.Counter + 2) % gGenomeSize];
-						const auto param2 = i_param2 / float(std::numeric_limits<GeneType>::max());
-
-						auto oldc = cell.Counter;
-						
-						switch (command1)
-						{
-						case EGene::MoveForward:
-						{
-							auto nvec = FVector2D(gRotations[cell.Rotation % 8].X, gRotations[cell.Rotation % 8].Y) * param1 * 10;
-							cell.Speed += nvec;
-							cell.Energy -= nvec.Size();
-							cell.Counter += 1;
-						}
-						break;
-
-						case EGene::Olding:
-						{
-							cell.Age += 10 * param1;
-							cell.Counter += 2;
-						}
-						break;
-
-						case EGene::Photo:
-						{
-							cell.Energy += photoenergy;
-							cell.Counter += 1;
-							cell.FeedType = 1;
-						}
-						break;
-
-						case EGene::Chemo:
-						{
-							cell.Energy += chemenergy;
-							cell.Counter += 1;
-							cell.FeedType = 2;
-						}
-						break;
-
-						case EGene::Mitose:
-						{
-							if (cell.Age > 10)
-							{
-								auto npos = Vec2i(i, j) + gRotations[cell.Rotation % 8];
-								auto n_index = CellToIndex(npos);
-								if (mArray[n_index].IsEmpty())
-								{
-									if (cell.Energy > 1)
-									{
-										auto & ncell = mArray[n_index];
-										ncell.SetGenome(cell.Genome);
-
-										if (rstream.RandRange(0, 10 * MutationRatio) == 1)
-										{
-											Mutate(ncell, true);
-										}
-										if (rstream.RandRange(0, 10 * MutationRatio) == 1)
-										{
-											Mutate(cell, true);
-										}
-										ncell.Speed = ncell.Speed;
-										ncell.Rotation = cell.Rotation + i_param1;
-										ncell.Energy = cell.Energy * param2 * 0.5;
-										mArray[n_index] = ncell;
-										cell.Energy = cell.Energy * (1 - param2) * 0.5;
-										cell.Age = 0;
-										ncell.Age = 0;
-									}
-								}
-							}
-
-							cell.Counter += 3;
-						}
-						break;
-
-						case EGene::RotateCW:
-						{
-							cell.Rotation += param1 * 360;
-							cell.Energy -= param1 * 0.1;
-
-							cell.Counter += 2;
-						}
-						break;
-
-						case EGene::RotateCCW:
-						{
-							cell.Rotation -= param1 * 360;
-							cell.Energy -= param1 * 0.1;
-
-							cell.Counter += 2;
-						}
-						break;
-
-						case EGene::GiveEnergy:
-						{
-							auto npos = Vec2i(i, j) + gRotations[cell.Rotation % 8];
-							auto n_index = CellToIndex(npos);
-							if (!mArray[n_index].IsEmpty() && n_index != self_index)
-							{
-								auto ncell = mArray[n_index];
-
-								ncell.Energy += cell.Energy * param2 * 0.75;
-								cell.Energy -= cell.Energy * param2;
-								cell.FeedType = 3;
-							}
-
-							cell.Counter += 3;
-						}
-						break;
-
-						case EGene::Regen:
-						{
-							cell.Age *= param1;
-							cell.Energy *= param1;
-
-							cell.Counter += 2;
-						}
-						break;
-
-						case EGene::TakeEnergy:
-						{
-							auto npos = Vec2i(i, j) + gRotations[cell.Rotation % 8];
-							auto n_index = CellToIndex(npos);
-							if (!mArray[n_index].IsEmpty() && n_index != self_index)
-							{
-								auto ncell = mArray[n_index];
-
-								if (!ncell.IsDead())
-								{
-									if (cell.IsFriend(ncell))
-									{
-										cell.Energy += ncell.Energy * param2 * 0.75f;
-										cell.FeedType = 3;
-									}
-									else
-									{
-										cell.Energy += ncell.Energy * param2 * 20.f;
-										cell.FeedType = 4;
-									}
-								}
-								else
-								{
-									cell.Energy += ncell.Energy * param2 * 10.f;
-									cell.FeedType = 5;
-								}
-								ncell.Energy -= ncell.Energy * param2;
-							}
-
-							cell.Counter += 3;
-						}
-						break;
-
-						case EGene::DetectFriend:
-						{
-							auto npos = Vec2i(i, j) + gRotations[cell.Rotation % 8];
-							auto n_index = CellToIndex(npos);
-							if (!mArray[n_index].IsEmpty() && n_index != self_index)
-							{
-								auto ncell = mArray[n_index];
-
-								if (ncell.IsFriend(cell))
-								{
-									cell.Counter = i_param2;
-									//jumped = true;
-									//goto single_jump;
-								}
-							}
-
-							cell.Counter += 3;
-							//jumped = true;
-							//goto single_jump;
-						}
-						break;
-
-						case EGene::Counter:
-						{
-							cell.Counter = i_param1;
-							//jumped = true;
-							//goto single_jump;
-						}
-						break;
-
-						//case EGene::DetectOther:
-						//{
-						//	auto npos = Vec2i(i, j) + gRotations[cell.Rotation % 8];
-						//	auto n_index = CellToIndex(npos);
-						//	if (!mArray[n_index].IsEmpty() && n_index != self_index)
-						//	{
-						//		auto ncell = mArray[n_index];
-
-						//		if (ncell.IsOther(cell))
-						//		{
-						//			cell.Counter = i_param2;
-						//			//jumped = true;
-						//			//goto single_jump;
-						//		}
-						//	}
-
-						//	cell.Counter += 3;
-						//	//jumped = true;
-						//	//goto single_jump;
-						//}
-						//break;
-
-						case EGene::Death:
-						{
-							cell.Genome[0] = EGene::Death;
-						}
-
-						case EGene::DetectEnergy:
-						{
-							if (cell.Energy >= param1 * 100)
-							{
-								cell.Counter = i_param2;
-								//jumped = true;
-								//goto single_jump;
-							}
-
-							cell.Counter += 3;
-							//jumped = true;
-							//goto single_jump;
-						}
-						break;
-						}
-
-					//double_jump:
-
-						if (oldc == cell.Counter)
-						{
-							++cell.Counter;
-						}
-
-						if (rstream.RandRange(0, cell.Age) > 10000)
-						{
-							Mutate(cell, true);
-							cell.Age = 0;
-						}
-
-						if (cell.accumulated_delta.X > 1)
-						{
-							auto n_index = CellToIndex({ i + 1, j });
-							if (mArray[n_index].IsEmpty())
-							{
-								cell.accumulated_delta.X -= 1;
-								std::swap(mArray[self_index], mArray[n_index]);
-							}
-							else
-							{
-								//mArray[n_index]->Speed += cell->Speed * 0.8f;
-								//cell.Speed = {};
-								cell.accumulated_delta = {};
-								cell.Speed /= 2.f;
-							}
-						}
-						else if (cell.accumulated_delta.X < -1)
-						{
-							auto n_index = CellToIndex({ i - 1, j });
-							if (mArray[n_index].IsEmpty())
-							{
-								cell.accumulated_delta.X += 1;
-								std::swap(mArray[self_index], mArray[n_index]);
-							}
-							else
-							{
-								//mArray[n_index]->Speed += cell->Speed * 0.8f;
-								//cell.Speed = {};
-								cell.accumulated_delta = {};
-								cell.Speed /= 2.f;
-							}
-						}
-						else if (cell.accumulated_delta.Y < -1)
-						{
-							auto n_index = CellToIndex({ i, j - 1 });
-							if (mArray[n_index].IsEmpty())
-							{
-								cell.accumulated_delta.Y += 1;
-								std::swap(mArray[self_index], mArray[n_index]);
-							}
-							else
-							{
-								//mArray[n_index]->Speed += cell->Speed * 0.8f;
-								//cell.Speed = {};
-								cell.accumulated_delta = {};
-								cell.Speed /= 2.f;
-							}
-						}
-						else if (cell.accumulated_delta.Y > 1)
-						{
-							auto n_index = CellToIndex({ i, j + 1 });
-							if (mArray[n_index].IsEmpty())
-							{
-								cell.accumulated_delta.Y -= 1;
-								std::swap(mArray[self_index], mArray[n_index]);
-							}
-							else
-							{
-								//cell.Speed = {};
-								cell.accumulated_delta = {};
-								cell.Speed /= 2.f;
-							}
-						}
-
-						cell.Age += 1;
-
-						if (cell.Energy > 100 && rstream.RandHelper(100) == 1)
-						{
-							//cell.Energy = 110;
-							cell.Genome[0] = EGene::Death;
-							//Mutate(cell, false);
-						}
-
-						cell.Energy -= 0.5f;
-					}
-					else
-					{
-						cell.Energy *= .99f;
-						cell.Energy -= 0.1f;
-					}
-
-					if (cell.Energy < 1)
-					{
-						cell.Kill();
-						cell.Energy = 0;
-					}
-				}
-			}
-		}
+		Population.FeedTypes[k] = stats.Feed[k];
+	}
 
-		LastUpdated = updated;
-		if (updated < 20)
-		{
-			Repopulate();
-		}
+	Population.Ages.SetNum(PopulationStats::AgeBuckets);
+	for (int32 k = 0; k < PopulationStats::AgeBuckets; ++k)
+	{
+		Population.Ages[k] = stats.Ages[k];
 	}
 
-	auto tick2 = FPlatformTime::Seconds();
-	TickDuration = tick2 - tick1;
+	Population.Genes.SetNum(EGene_MAX);
+	for (int32 k = 0; k < EGene_MAX; ++k)
+	{
+		Population.Genes[k] = static_cast<int32>(stats.Genes[k]);
+	}
+}
 
-	if (LastUpdated < 300)
+void ACellActor::MeasureSpeed(uint64 step_count, float DeltaSeconds)
+{
+	// a reset or a load starts the count over, that frame says nothing
+	if (step_count >= MeasuredStep && DeltaSeconds > 0)
 	{
-		Repopulate();
+		const float speed = (step_count - MeasuredStep) / DeltaSeconds;
+		IterationsPerSecond += (speed - IterationsPerSecond) * 0.1f;
 	}
+	MeasuredStep = step_count;
 }
 
-void ACellActor::BeginPlay()
+void ACellActor::ReadProfile(const TickProfile & profile)
 {
-	Super::BeginPlay();
+#if CELL_PROFILE
+	const auto milliseconds = [&](EPhase phase)
+	{
+		return static_cast<float>(profile.PhaseSeconds[static_cast<int32>(phase)] * 1000);
+	};
+	SET_FLOAT_STAT(STAT_CellIntegrate, milliseconds(EPhase::Integrate));
+	SET_FLOAT_STAT(STAT_CellInterpret, milliseconds(EPhase::Interpret));
+	SET_FLOAT_STAT(STAT_CellResolve, milliseconds(EPhase::Resolve));
+	SET_FLOAT_STAT(STAT_CellCompact, milliseconds(EPhase::Compact));
+	SET_FLOAT_STAT(STAT_CellRepopulate, milliseconds(EPhase::Repopulate));
+	SET_FLOAT_STAT(STAT_CellChecksum, milliseconds(EPhase::Checksum));
+
+	uint64 genes = 0;
+	for (auto runs : profile.GeneRuns)
+	{
+		genes += runs;
+	}
+	SET_DWORD_STAT(STAT_CellGenes, static_cast<uint32>(genes));
+	SET_DWORD_STAT(STAT_CellMutations, static_cast<uint32>(profile.Mutations));
 
-	rstream.GenerateNewSeed();
+	if (!ShowProfile || !GEngine)
+	{
+		return;
+	}
+
+	// a line for the phases and one for the genes that took the most cycles, replaced every frame
+	const uint64 key = static_cast<uint64>(GetUniqueID()) << 8;
+
+	FString phases = FString::Printf(TEXT("%s %.2f ms"), ANSI_TO_TCHAR(TickProfile::GetPhaseName(EPhase::Integrate)), milliseconds(EPhase::Integrate));
+	for (int32 k = 1; k < TickProfile::Phases; ++k)
+	{
+		const auto phase = static_cast<EPhase>(k);
+		phases += FString::Printf(TEXT(", %s %.2f ms"), ANSI_TO_TCHAR(TickProfile::GetPhaseName(phase)), milliseconds(phase));
+	}
+	GEngine->AddOnScreenDebugMessage(key, 0.f, FColor::Yellow, phases);
 
-	Repopulate();
+	std::array<int32, EGene_MAX> order;
+	double cycles = 0;
+	for (int32 gene = 0; gene < EGene_MAX; ++gene)
+	{
+		order[gene] = gene;
+		cycles += profile.GetGeneCycles(gene);
+	}
+	std::partial_sort(order.begin(), order.begin() + 5, order.end(), [&](int32 a, int32 b)
+	{
+		return profile.GetGeneCycles(a) > profile.GetGeneCycles(b);
+	});
+
+	FString costliest = FString::Printf(TEXT("%llu genes, %llu mutations:"), static_cast<unsigned long long>(genes), static_cast<unsigned long long>(profile.Mutations));
+	for (int32 k = 0; k < 5 && cycles > 0; ++k)
+	{
+		costliest += FString::Printf(TEXT(" %s %.0f%%"), ANSI_TO_TCHAR(TickProfile::GetGeneName(order[k])), 100 * profile.GetGeneCycles(order[k]) / cycles);
+	}
+	GEngine->AddOnScreenDebugMessage(key + 1, 0.f, FColor::Yellow, costliest);
+#endif
 }
 
-void ACellActor::Repopulate()
+TArray<FCellSpecies> ACellActor::GetTopSpecies(int32 count) const
 {
-	time_ticks = 0;
-
-	for (int i = 0; i < gSize.Capacity(); ++i)
-	{
-		mArray[i].Speed = FVector2D(0);
-		mArray[i].Rotation = 0;
-		mArray[i].Genome[0] = EGene::Death;
-		mArray[i].Age = 0;
-		mArray[i].Energy = -1;
-	}
-
-	TArray<uint8> ggg;
-	/*0*/ggg.Add(uint8(EGene::Photo));
-	/*1*/ggg.Add(uint8(EGene::DetectEnergy));
-	/*2*/ggg.Add(100);
-	/*3*/ggg.Add(6);
-	/*4*/ggg.Add(uint8(EGene::Counter));
-	/*5*/ggg.Add(0);
-	/*6*/ggg.Add(uint8(EGene::Mitose));
-	/*7*/ggg.Add(0);
-	/*8*/ggg.Add(128);
-	/*0*/ggg.Add(uint8(EGene::Chemo));
-	/*4*/ggg.Add(uint8(EGene::Counter));
-	/*5*/ggg.Add(0);
-
-	for (int32 i = 0; i < 10000; ++i)
-	{
-		Cell ncell;
-		ncell.Speed = { rstream.GetFraction(),rstream.GetFraction() };
-		ncell.Rotation = rstream.RandHelper(std::numeric_limits<GeneType>::max());
-		ncell.Energy = rstream.GetFraction() * 100;
-
-		for (int g = 0; g <gGenomeSize; ++g)
-		{
-			ncell.Genome[g] = rstream.RandHelper(std::numeric_limits<GeneType>::max());
-		}
-		ncell.Genome[0] = EGene::Photo;
-		ncell.SetGenome(ncell.Genome);
+	TArray<FCellSpecies> species;
+	auto read = [&](const CellSimulation & simulation)
+	{
+		std::vector<const GenomeProgram *> programs;
+		simulation.mArray.Programs.GetTopSpecies(count, programs);
 
-		/*for (int g = 0; g < ggg.Num(); ++g)
+		species.Reserve(static_cast<int32>(programs.size()));
+		for (auto program : programs)
 		{
-			ncell.Genome[g] = ggg[g];
-		}*/
+			FCellSpecies entry;
+			entry.Fingerprint = static_cast<int64>(program->Fingerprint);
+			entry.Population = program->Population;
+			species.Add(entry);
+		}
+	};
 
-		mArray[rstream.RandHelper(gSize.Capacity())] = std::move(ncell);
+	// programs die with the cells, so they are only read between two ticks
+	if (Thread)
+	{
+		Thread->Execute(read);
 	}
+	else
+	{
+		read(Simulation);
+	}
+	return species;
 }
 
-bool Cell::IsFriend(const Cell & other) const
+bool ACellActor::SaveSnapshot(const FString & path)
 {
-	return GenomeSum == other.GenomeSum;
-}
+	if (PendingSave.valid() && PendingSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		return false;
+	}
 
-bool Cell::IsOther(const Cell & other) const
-{
+	const std::string file = TCHAR_TO_UTF8(*path);
+	if (Thread)
+	{
+		// only the copy of the world is taken between ticks, it is written in the background as usual
+		Thread->Execute([&](CellSimulation & simulation)
+		{
+			PendingSave = simulation.SaveSnapshot(file);
+		});
+	}
+	else
+	{
+		PendingSave = Simulation.SaveSnapshot(file);
+	}
 	return true;
 }
 
-bool Cell::IsDead() const
+bool ACellActor::LoadSnapshot(const FString & path)
 {
-	return Genome[0] == EGene::Death;
-}
+	const std::string file = TCHAR_TO_UTF8(*path);
 
-void Cell::Kill()
-{
-	Genome[0] = EGene::Death;
-	Speed = FVector2D(0);
-	accumulated_delta = {};
-	Rotation = 0;
-	GenomeSum = 0;
-	GeneDeviation = 0;
+	bool loaded = false;
+	SimulationParameters parameters;
+	PopulationStats stats;
+	int32 last_updated = 0;
+	auto load = [&](CellSimulation & simulation)
+	{
+		loaded = simulation.LoadSnapshot(file);
+		parameters = simulation.Parameters;
+		stats = simulation.Stats;
+		last_updated = simulation.LastUpdated;
+	};
+
+	if (Thread)
+	{
+		Thread->Execute(load);
+	}
+	else
+	{
+		load(Simulation);
+	}
+
+	if (!loaded)
+	{
+		return false;
+	}
+
+	ReadParameters(parameters);
+	ReadStats(stats);
+	LastUpdated = last_updated;
+	return true;
 }
 
-bool Cell::IsEmpty() const
+void ACellActor::Tick(float DeltaSeconds)
 {
-	return IsDead() && Energy <= 0;
+	Super::Tick(DeltaSeconds);
+
+	SCOPE_CYCLE_COUNTER(STAT_CellTick);
+
+	if (Thread)
+	{
+		// the frame only hands over the properties and picks up whatever was published last
+		SimulationParameters parameters = View->Parameters;
+		ApplyParameters(parameters);
+		Thread->SetParameters(parameters);
+		Thread->SetPace(FMath::CeilToInt(Acceleration), TickRate, FrameBudgetMs / 1000.0);
+
+		const uint64 previous_step = View->StepCount;
+		View = &Thread->AcquireView();
+		LastUpdated = View->LastUpdated;
+		TickUpdated = View->TickUpdated;
+		Checksum = static_cast<int64>(View->RollingChecksum);
+		ReadStats(View->Stats);
+		ReadProfile(View->Profile);
+		TickDuration = View->TickSeconds;
+		TickIterations = static_cast<int32>(View->StepCount - previous_step);
+		BudgetUsed = FrameBudgetMs > 0 ? TickDuration * 1000.f / FrameBudgetMs : 0.f;
+		MeasureSpeed(View->StepCount, DeltaSeconds);
+		return;
+	}
+
+	auto tick1 = FPlatformTime::Seconds();
+
+	ApplyParameters(Simulation.Parameters);
+	if (FrameBudgetMs > 0)
+	{
+		TickIterations = Simulation.RunBudgeted(FrameBudgetMs / 1000.0, FMath::CeilToInt(Acceleration));
+	}
+	else
+	{
+		TickIterations = FMath::CeilToInt(Acceleration);
+		Simulation.Run(TickIterations);
+	}
+
+	LastUpdated = Simulation.LastUpdated;
+	TickUpdated = Simulation.TickUpdated;
+	Checksum = static_cast<int64>(Simulation.GetRollingChecksum());
+	ReadStats(Simulation.Stats);
+	ReadProfile(Simulation.Profile);
+
+	auto tick2 = FPlatformTime::Seconds();
+	TickDuration = tick2 - tick1;
+	BudgetUsed = FrameBudgetMs > 0 ? TickDuration * 1000.f / FrameBudgetMs : 0.f;
+	MeasureSpeed(Simulation.GetStepCount(), DeltaSeconds);
 }
 
-void Cell::SetGenome(std::array<uint8, gGenomeSize> arr)
+void ACellActor::BeginPlay()
 {
-	Genome = arr;
+	Super::BeginPlay();
+
+	// parallel passes of the core run on the task graph instead of its own threads
+	SetParallelRunner([](int32 count, const ParallelBody & body)
+	{
+		ParallelFor(count, body);
+	});
 
-	GenomeSum = 0;
-	for (auto gg : arr)
+	ApplyParameters(Simulation.Parameters);
+	Simulation.Parameters.WorldSize = Vec2i(WorldSize.X, WorldSize.Y);
+	Simulation.Parameters.HugePages = UseHugePages;
+
+	if (!ReplayLogPath.IsEmpty())
+	{
+		Replay = std::make_unique<ReplayLog>();
+		Replay->Open(TCHAR_TO_UTF8(*ReplayLogPath));
+		Simulation.Replay = Replay.get();
+	}
+
+	if (StartSnapshot.IsEmpty() || !LoadSnapshot(StartSnapshot))
+	{
+		Simulation.Reset(Deterministic ? Seed : FMath::Rand());
+	}
+
+	if (!RecordingPath.IsEmpty())
+	{
+		// ERecordLense bits are numbered like ELense
+		uint32 lenses = 0;
+		for (ELense lense : RecordedLenses)
+		{
+			lenses |= 1u << static_cast<uint32>(lense);
+		}
+
+		Recorder = std::make_unique<SimulationRecorder>();
+		if (Recorder->Open(TCHAR_TO_UTF8(*RecordingPath), lenses & RecordAllLenses, FMath::Max(RecordInterval, 1)))
+		{
+			Simulation.Recorder = Recorder.get();
+		}
+		else
+		{
+			Recorder.reset();
+		}
+	}
+
+	if (RunOnThread)
 	{
-		GenomeSum += gg;
+		Thread = std::make_unique<SimulationThread>(Simulation);
+		Thread->SetPace(FMath::CeilToInt(Acceleration), TickRate, FrameBudgetMs / 1000.0);
+		Thread->Start();
+		View = &Thread->AcquireView();
 	}
 }
+
+void ACellActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// the lenses go back to reading Simulation, which nothing steps now
+	Thread.reset();
+	View = nullptr;
+
+	// the writer finishes the frames it was handed and the index
+	Simulation.Recorder = nullptr;
+	Recorder.reset();
+
+	Super::EndPlay(EndPlayReason);
+}
@@ -3,190 +3,16 @@
 #include "CoreMinimal.h"
 #include "Engine/Texture2D.h"
 #include "GameFramework/Actor.h"
-#include "Vector.h"
-#include "Math/Vector.h"
-#include <limits>
-#include <Templates/Function.h>
+#include <RenderCommandFence.h>
 #include <array>
+#include <limits>
+#include "Simulation/Recorder.h"
+#include "Simulation/Replay.h"
+#include "Simulation/Simulation.h"
+#include "Simulation/SimulationThread.h"
 #include "Cell.generated.h"
 
-struct FVector2i
-{
-
-public:
-
-	int32 X;
-	int32 Y;
-
-public:
-
-	FVector2i()
-		: X(0)
-		, Y(0)
-	{}
-
-	constexpr FVector2i(int32 inX, int32 inY)
-		: X(inX)
-		, Y(inY)
-	{}
-
-	constexpr explicit FVector2i(int32 value)
-		: X(value), Y(value)
-	{}
-
-	constexpr explicit FVector2i(EForceInit)
-		: X(0)
-		, Y(0)
-	{}
-
-	constexpr FVector2i(const FVector2i &other)
-		: X(other.X)
-		, Y(other.Y)
-	{}
-
-	constexpr FVector2i(const FVector2D &other)
-		: X(static_cast<int>(other.X))
-		, Y(static_cast<int>(other.Y))
-	{}
-
-	constexpr FVector2i(FVector2i &&other)
-		: X(other.X)
-		, Y(other.Y)
-	{}
-
-	FVector2i & operator = (const FVector2i &other)
-	{
-		X = other.X;
-		Y = other.Y;
-
-		return *this;
-	}
-
-	FVector2i & operator = (FVector2i &&other)
-	{
-		X = other.X;
-		Y = other.Y;
-
-		return *this;
-	}
-
-	FVector2i operator + (FVector2i &other) const
-	{
-		return FVector2i(X + other.X, Y + other.Y);
-	}
-
-public:
-
-	~FVector2i() = default;
-
-public:
-
-	constexpr bool operator==(const FVector2i& other) const
-	{
-		return X == other.X && Y == other.Y;
-	}
-	constexpr bool operator!=(const FVector2i& other) const
-	{
-		return X != other.X || Y != other.Y;
-	}
-	constexpr FVector2i operator*(int32 scale) const
-	{
-		return FVector2i(X * scale, Y * scale);
-	}
-	constexpr FVector2i operator*(const FVector2i& other) const
-	{
-		return FVector2i(X * other.X, Y * other.Y);
-	}
-	constexpr FVector2i operator/(int32 divisor) const
-	{
-		return FVector2i(X / divisor, Y / divisor);
-	}
-	constexpr FVector2i operator/(const FVector2i& other) const
-	{
-		return FVector2i(X / other.X, Y / other.Y);
-	}
-	constexpr FVector2i operator+(const FVector2i& other) const
-	{
-		return FVector2i(X + other.X, Y + other.Y);
-	}
-	constexpr FVector2i operator-(const FVector2i& other) const
-	{
-		return FVector2i(X - other.X, Y - other.Y);
-	}
-	constexpr FVector2i operator-() const
-	{
-		return FVector2i(-X, -Y);
-	}
-	constexpr FVector2i operator+(int32 value) const
-	{
-		return FVector2i(X + value, Y + value);
-	}
-	constexpr FVector2i operator-(int32 value) const
-	{
-		return FVector2i(X - value, Y - value);
-	}
-
-	//   Vector3& operator*=(int32 scale);
-	//   Vector3& operator/=(int32 divisor);
-	//   Vector3& operator+=(const Vector3& other);
-	//   Vector3& operator-=(const Vector3& other);
-	//   Vector3& operator=(const Vector3& other);
-
-	constexpr bool IsZero() const
-	{
-		return X == 0 && Y == 0;
-	}
-
-	constexpr int32 Capacity() const
-	{
-		return X * Y;
-	}
-
-public:
-	operator FIntVector() const
-	{
-		return FIntVector(X, Y, 0);
-	}
-
-	friend FORCEINLINE uint32 GetTypeHash(const FVector2i& Vector3)
-	{
-		return FCrc::MemCrc_DEPRECATED(&Vector3, sizeof(FVector2i));
-	}
-};
-
-using Vec2i = FVector2i;
-
-constexpr FVector2i gSize = FVector2i(256, 256);
-constexpr uint32 gGenomeSize = 64;
-using GeneType = uint8;
-using AgeType = uint16;
-
-using RotationType = uint8;
-constexpr RotationType gRotationsCount = 8;
-constexpr std::array<Vec2i, gRotationsCount> gRotations = { Vec2i(0, 1),  Vec2i(1, 1), Vec2i(1, 0), Vec2i(1, -1), Vec2i(0, -1), Vec2i(-1, -1), Vec2i(-1, 0), Vec2i(-1, 1) };
-
-enum EGene : GeneType
-{
-	Trash,
-	MoveForward,
-	MoveBackward,
-	RotateCCW,
-	RotateCW,
-	Photo,
-	Chemo,
-	Death,
-	EatForward,
-	Mitose,
-	GiveEnergy,
-	TakeEnergy,
-	Olding,
-	Regen,
-	Counter,
-	DetectFriend,
-	//DetectOther,
-	DetectEnergy,
-	EGene_MAX,
-};
+class FTexture2DResource;
 
 UENUM(BlueprintType)
 enum class ELense : uint8
@@ -197,81 +23,69 @@ enum class ELense : uint8
 	Feed,
 };
 
-inline constexpr Vec2i IndexToCell(int32 i, const Vec2i &size = gSize)
+// what lies past the edges of the world, as ETopology
+UENUM(BlueprintType)
+enum class ECellTopology : uint8
 {
-	return Vec2i{ static_cast<int32>(i / size.Y),
-		static_cast<int32>(i % size.Y) };
-}
+	// X wraps around, Y ends at walls
+	Cylinder,
+	// X and Y wrap around
+	Torus,
+	// walls on all four sides
+	Box,
+};
 
-inline constexpr int32 CellToIndex(const Vec2i &_pos, const Vec2i &size = gSize)
+// Population aggregates of the world, copied from the simulation after every tick
+USTRUCT(BlueprintType)
+struct FCellPopulationStats
 {
-	auto pos = _pos;
-	/*if (pos.X >= size.X)
-	{
-		pos.X = pos.X - size.X;
-	}
-	if (pos.Y >= size.Y)
-	{
-		pos.Y = pos.Y - size.Y;
-	}
-	if (pos.X < 0)
-	{
-		pos.X = pos.X + size.X;
-	}
-	if (pos.Y < 0)
-	{
-		pos.Y = pos.Y + size.Y;
-	}*/
+	GENERATED_BODY()
 
-	if (pos.X >= size.X)
-	{
-		pos.X = pos.X - size.X;
-	}
-	if (pos.Y >= size.Y)
-	{
-		pos.Y = size.Y - 1;
-	}
-	if (pos.X < 0)
-	{
-		pos.X = pos.X + size.X;
-	}
-	if (pos.Y < 0)
-	{
-		pos.Y = 0;
-	}
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int32 Live = 0;
 
-	return static_cast<int32>(pos.X) * size.Y +
-		static_cast<int32>(pos.Y);
-}
+	// dead cells that have not decayed yet
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int32 Decaying = 0;
 
-class Cell
-{
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		float LiveEnergy = 0;
 
-public:
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		float DecayingEnergy = 0;
+
+	// distinct genomes among live cells
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int32 Species = 0;
+
+	// live cells by FeedType: none yet, photo, chemo, from friends, from others, from corpses
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		TArray<int32> FeedTypes;
+
+	// live cells by age, entry b holds ages [4^b - 1, 4^(b + 1) - 1)
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		TArray<int32> Ages;
 
-	std::array<uint8, gGenomeSize> Genome;
-
-	RotationType Rotation = 0;
-	FVector2D Speed = {};
-	float Energy = 0;
-	uint16 Counter = 0;
-	uint16 Age = 0;
-	uint16 GenomeSum = 0;
-	uint8 GeneDeviation = 0;
-	uint8 FeedType = 0;
-
-	FVector2D accumulated_delta;
-
-	bool IsFriend(const Cell & other) const;
-	bool IsOther(const Cell & other) const;
-	bool IsDead() const;
-	void Kill();
-	bool IsEmpty() const;
-	void SetGenome(std::array<uint8, gGenomeSize> arr);
+	// genes over the genomes of live cells, by EGene
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		TArray<int32> Genes;
 };
 
-static std::array<Cell, gSize.Capacity()> mArray;
+// One genome and the live cells carrying it
+USTRUCT(BlueprintType)
+struct FCellSpecies
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int64 Fingerprint = 0;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int32 Population = 0;
+};
 
+// Hosts a CellSimulation in the level: steps it every frame with the parameters
+// set in the editor and draws its lens textures.
 UCLASS()
 class CELLFACTORY_API ACellActor : public AActor
 {
@@ -279,10 +93,31 @@ class CELLFACTORY_API ACellActor : public AActor
 
 public:
 
+	// Returns the texture of the lens, created on first use and kept by the actor.
+	// Later calls only upload the rows that changed since the previous call.
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+		UTexture2D * GenerateTexture(ELense lense);
+
+	// GenerateTexture for several lenses at once, drawn in a single sweep over the grid.
+	// Textures come back in the order of the lenses.
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+		TArray<UTexture2D *> GenerateTextures(const TArray<ELense> & lenses);
+
+	// Starts writing the world to a snapshot file in the background, false while an earlier
+	// save is still being written
 	UFUNCTION(BlueprintCallable)
-		UTexture2D * GenerateTexture(ELense lense) const;
+		bool SaveSnapshot(const FString & path);
 
-	void Mutate(Cell & cell, bool rehash);
+	// The count species with the most live cells, most first. Costs a pass over the
+	// species, not over the world.
+	UFUNCTION(BlueprintCallable)
+		TArray<FCellSpecies> GetTopSpecies(int32 count) const;
+
+	// Replaces the world and the simulation parameters with a snapshot file
+	UFUNCTION(BlueprintCallable)
+		bool LoadSnapshot(const FString & path);
+
+	void Mutate(CellRef cell, bool rehash);
 
 	float GetTime() const;
 	float GetLight(int32 depth) const;
@@ -297,6 +132,22 @@ public:
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
 		float TickDuration = 0.f;
 
+	// steps the world moved on during the last Tick
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int32 TickIterations = 0;
+
+	// steps per second of game time, smoothed over recent frames
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		float IterationsPerSecond = 0.f;
+
+	// TickDuration as a share of FrameBudgetMs, above 1 when a single step did not fit
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		float BudgetUsed = 0.f;
+
+	// kept up to date by the simulation as it steps, reading it scans nothing
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		FCellPopulationStats Population;
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 		float SunMin = 4;
 
@@ -309,23 +160,175 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 		float MinMin = 0;
 
+	// steps per Tick, the most of them with a FrameBudgetMs
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 		float Acceleration = 25;
 
+	// milliseconds a Tick may spend stepping, it runs as many steps as are expected to fit;
+	// 0 always runs Acceleration steps
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0"))
+		float FrameBudgetMs = 0;
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 		float MutationRatio = 1;
 
+	// control genes (Counter, DetectFriend, DetectEnergy) a cell runs per step before the
+	// gene that ends its turn, 0 for one gene per step
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0"))
+		int32 FreeControlGenes = 0;
+
+	// step the world on a thread of its own instead of in Tick, the frame then only reads
+	// the latest published copy of it; takes effect at BeginPlay
+	UPROPERTY(BlueprintReadOnly, EditAnywhere)
+		bool RunOnThread = false;
+
+	// ticks of Acceleration steps per second on the simulation thread, 0 for as many as it manages
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0"))
+		float TickRate = 60;
+
+	// update the world tile by tile on worker threads instead of one serial sweep
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		bool ParallelTick = false;
+
+	// edge of a world chunk in cells, snapped to a power of two in [2, WorldSize.X / 2],
+	// chunks are also the tiles of the parallel tick
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		int32 TileSize = 32;
+
+	// keep the active cell list in memory order for locality, costs a sort per iteration
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		bool SortActiveCells = true;
+
+	// cells along X (wrapping) and Y (depth), the world is made at BeginPlay
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, meta = (ClampMin = "4"))
+		FIntPoint WorldSize = FIntPoint(256, 256);
+
+	// what a cell at an edge of the world sees and moves into past it
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		ECellTopology Topology = ECellTopology::Cylinder;
+
+	// back large worlds with huge pages where the OS offers them
+	UPROPERTY(BlueprintReadOnly, EditAnywhere)
+		bool UseHugePages = true;
+
+	// snapshot BeginPlay continues from instead of a new world, when set and readable
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		FString StartSnapshot;
+
+	// start from Seed and update in an order that does not depend on ParallelTick,
+	// so two runs can be compared step by step
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		bool Deterministic = false;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		int32 Seed = 0;
+
+	// steps between two world checksums, 0 for none
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		int32 ChecksumInterval = 0;
+
+	// file the checksums are logged to from BeginPlay on, when set
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		FString ReplayLogPath;
+
+	// file the lenses are recorded to from BeginPlay on, when set; frames the recorder
+	// has no room for are dropped instead of slowing the simulation down
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		FString RecordingPath;
+
+	// ticks between two recorded frames
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1"))
+		int32 RecordInterval = 1;
+
+	// the age lens is not recorded
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		TArray<ELense> RecordedLenses = { ELense::Energy };
+
+	// rolling checksum of the world as of the last checksum step
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int64 Checksum = 0;
+
+	// print the phases of the last tick and its costliest genes on screen, in builds with
+	// CELL_PROFILE (all but shipping); the same numbers are in the CellFactory stat group
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		bool ShowProfile = false;
+
 	virtual void Tick(float DeltaSeconds) override;
 
+	virtual bool IsReadyForFinishDestroy() override;
+
 protected:
 
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
-	void Repopulate();
+	// copies the editor properties into parameters
+	void ApplyParameters(SimulationParameters & parameters) const;
 
-	double max = std::numeric_limits<double>::min(), min = std::numeric_limits<double>::max();
+	// the other way round, after a snapshot brought its own parameters
+	void ReadParameters(const SimulationParameters & parameters);
+
+	// copies stats into Population
+	void ReadStats(const PopulationStats & stats);
+
+	// updates IterationsPerSecond from the step count the frame sees
+	void MeasureSpeed(uint64 step_count, float DeltaSeconds);
+
+	// hands the profile of the last tick to the stats system and the overlay
+	void ReadProfile(const TickProfile & profile);
+
+	uint64 MeasuredStep = 0;
+
+	std::future<bool> PendingSave;
+
+	std::unique_ptr<ReplayLog> Replay;
+
+	std::unique_ptr<SimulationRecorder> Recorder;
 
-	FRandomStream rstream;
+	CellSimulation Simulation;
 
-	uint64 time_ticks = 0;
+	// steps Simulation when RunOnThread, nothing else touches it then but through Execute
+	std::unique_ptr<SimulationThread> Thread;
+
+	// what the frame reads of the world when RunOnThread, acquired once per Tick
+	const WorldView * View = nullptr;
+
+	// light and minerals by depth for lenses drawn straight from Simulation
+	std::vector<float> LenseLight;
+	std::vector<float> LenseChemo;
+
+	void UpdateLenses(const ELense * lenses, int32 count);
+	static Vec2i GetLenseSize(ELense lense, const Vec2i & world_size);
+
+	// indexed by ELense
+	UPROPERTY(Transient)
+		TArray<UTexture2D *> LenseTextures;
+
+	// BGRA pixels of each lens texture, only touched by the game thread
+	TArray<TArray<uint32>> LenseStaging;
+	TArray<uint32> LenseStamps;
+
+	// The rows of one UpdateLenses call on their way to the render thread, packed one
+	// region after another. The render thread reads them until Fence passes.
+	struct FLenseUpload
+	{
+		struct FRegion
+		{
+			FTexture2DResource * Resource;
+			FUpdateTextureRegion2D Region;
+			uint32 Pitch;
+			int32 Offset;
+		};
+
+		TArray<uint32> Pixels;
+		TArray<FRegion> Regions;
+		FRenderCommandFence Fence;
+	};
+
+	// the game thread only waits for an upload when the render thread is this many behind
+	static constexpr int32 LenseUploads = 3;
+	std::array<FLenseUpload, LenseUploads> Uploads;
+	int32 NextUpload = 0;
+
+	double max = std::numeric_limits<double>::min(), min = std::numeric_limits<double>::max();
 };
\ No newline at end of file
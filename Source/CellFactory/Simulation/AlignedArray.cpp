@@ -0,0 +1,62 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "AlignedArray.h"
+
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	constexpr size_t gCacheLine = 64;
+	constexpr size_t gHugePage = 2 * 1024 * 1024;
+}
+
+void * AllocateAligned(size_t bytes, bool huge_pages)
+{
+	// blocks smaller than a huge page would only waste the rest of it
+	const bool huge = huge_pages && bytes >= gHugePage;
+	const size_t alignment = huge ? gHugePage : gCacheLine;
+	const size_t size = (bytes + alignment - 1) / alignment * alignment;
+
+	void * memory = nullptr;
+
+#if defined(_WIN32)
+	// large pages on Windows need the lock pages privilege, plain aligned memory there
+	memory = _aligned_malloc(size, alignment);
+#else
+	if (posix_memalign(&memory, alignment, size) != 0)
+	{
+		memory = nullptr;
+	}
+#endif
+
+	if (!memory)
+	{
+		// the game module builds without exceptions, a world that does not fit is fatal
+		std::abort();
+	}
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (huge)
+	{
+		madvise(memory, size, MADV_HUGEPAGE);
+	}
+#endif
+
+	std::memset(memory, 0, size);
+	return memory;
+}
+
+void FreeAligned(void * memory)
+{
+#if defined(_WIN32)
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
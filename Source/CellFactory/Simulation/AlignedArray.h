@@ -0,0 +1,107 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+// Zeroed block of at least bytes, aligned to a cache line. With huge_pages large blocks
+// are aligned to 2 MB and offered to the kernel for transparent huge pages where it has them.
+void * AllocateAligned(size_t bytes, bool huge_pages);
+void FreeAligned(void * memory);
+
+// Fixed-size array allocated at runtime through AllocateAligned, used for the world columns.
+// Only for types that are valid when zeroed and can be moved with memcpy.
+template <typename T>
+class AlignedArray
+{
+	static_assert(std::is_trivially_copyable<T>::value, "AlignedArray stores raw memory");
+
+public:
+
+	AlignedArray() = default;
+
+	AlignedArray(const AlignedArray &) = delete;
+	AlignedArray & operator = (const AlignedArray &) = delete;
+
+	AlignedArray(AlignedArray && other)
+		: Data(other.Data)
+		, Count(other.Count)
+	{
+		other.Data = nullptr;
+		other.Count = 0;
+	}
+
+	AlignedArray & operator = (AlignedArray && other)
+	{
+		std::swap(Data, other.Data);
+		std::swap(Count, other.Count);
+		return *this;
+	}
+
+	~AlignedArray()
+	{
+		Release();
+	}
+
+	// drops the contents, the new elements are zeroed
+	void Allocate(int32 count, bool huge_pages)
+	{
+		Release();
+		if (count > 0)
+		{
+			Data = static_cast<T *>(AllocateAligned(sizeof(T) * count, huge_pages));
+			Count = count;
+		}
+	}
+
+	void Release()
+	{
+		if (Data)
+		{
+			FreeAligned(Data);
+		}
+		Data = nullptr;
+		Count = 0;
+	}
+
+	void fill(const T & value)
+	{
+		for (int32 i = 0; i < Count; ++i)
+		{
+			Data[i] = value;
+		}
+	}
+
+	T & operator [] (int32 index)
+	{
+		return Data[index];
+	}
+
+	const T & operator [] (int32 index) const
+	{
+		return Data[index];
+	}
+
+	T * data() { return Data; }
+	const T * data() const { return Data; }
+
+	T * begin() { return Data; }
+	T * end() { return Data + Count; }
+	const T * begin() const { return Data; }
+	const T * end() const { return Data + Count; }
+
+	int32 size() const
+	{
+		return Count;
+	}
+
+private:
+
+	T * Data = nullptr;
+	int32 Count = 0;
+};
@@ -0,0 +1,362 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+// Basic types of the simulation core. The core is plain C++14 and never includes engine
+// headers, so it builds both inside the game module and standalone (see CMakeLists.txt).
+// The integer aliases are the same types the engine declares, so both can be visible.
+
+#include <array>
+#include <cmath>
+
+using uint8 = unsigned char;
+using uint16 = unsigned short int;
+using uint32 = unsigned int;
+using uint64 = unsigned long long;
+using int8 = signed char;
+using int16 = signed short int;
+using int32 = signed int;
+using int64 = signed long long;
+
+struct Vec2f
+{
+
+public:
+
+	float X = 0;
+	float Y = 0;
+
+public:
+
+	constexpr Vec2f() = default;
+
+	constexpr Vec2f(float inX, float inY)
+		: X(inX)
+		, Y(inY)
+	{}
+
+	constexpr explicit Vec2f(float value)
+		: X(value)
+		, Y(value)
+	{}
+
+public:
+
+	constexpr Vec2f operator+(const Vec2f& other) const
+	{
+		return Vec2f(X + other.X, Y + other.Y);
+	}
+	constexpr Vec2f operator-(const Vec2f& other) const
+	{
+		return Vec2f(X - other.X, Y - other.Y);
+	}
+	constexpr Vec2f operator*(float scale) const
+	{
+		return Vec2f(X * scale, Y * scale);
+	}
+	constexpr Vec2f operator/(float divisor) const
+	{
+		return Vec2f(X / divisor, Y / divisor);
+	}
+
+	Vec2f& operator+=(const Vec2f& other)
+	{
+		X += other.X;
+		Y += other.Y;
+		return *this;
+	}
+	Vec2f& operator-=(const Vec2f& other)
+	{
+		X -= other.X;
+		Y -= other.Y;
+		return *this;
+	}
+	Vec2f& operator*=(float scale)
+	{
+		X *= scale;
+		Y *= scale;
+		return *this;
+	}
+	Vec2f& operator/=(float divisor)
+	{
+		X /= divisor;
+		Y /= divisor;
+		return *this;
+	}
+
+	float Size() const
+	{
+		return std::sqrt(X * X + Y * Y);
+	}
+};
+
+struct FVector2i
+{
+
+public:
+
+	int32 X;
+	int32 Y;
+
+public:
+
+	FVector2i()
+		: X(0)
+		, Y(0)
+	{}
+
+	constexpr FVector2i(int32 inX, int32 inY)
+		: X(inX)
+		, Y(inY)
+	{}
+
+	constexpr explicit FVector2i(int32 value)
+		: X(value), Y(value)
+	{}
+
+	constexpr FVector2i(const FVector2i &other)
+		: X(other.X)
+		, Y(other.Y)
+	{}
+
+	constexpr FVector2i(const Vec2f &other)
+		: X(static_cast<int>(other.X))
+		, Y(static_cast<int>(other.Y))
+	{}
+
+	constexpr FVector2i(FVector2i &&other)
+		: X(other.X)
+		, Y(other.Y)
+	{}
+
+	FVector2i & operator = (const FVector2i &other)
+	{
+		X = other.X;
+		Y = other.Y;
+
+		return *this;
+	}
+
+	FVector2i & operator = (FVector2i &&other)
+	{
+		X = other.X;
+		Y = other.Y;
+
+		return *this;
+	}
+
+	FVector2i operator + (FVector2i &other) const
+	{
+		return FVector2i(X + other.X, Y + other.Y);
+	}
+
+public:
+
+	~FVector2i() = default;
+
+public:
+
+	constexpr bool operator==(const FVector2i& other) const
+	{
+		return X == other.X && Y == other.Y;
+	}
+	constexpr bool operator!=(const FVector2i& other) const
+	{
+		return X != other.X || Y != other.Y;
+	}
+	constexpr FVector2i operator*(int32 scale) const
+	{
+		return FVector2i(X * scale, Y * scale);
+	}
+	constexpr FVector2i operator*(const FVector2i& other) const
+	{
+		return FVector2i(X * other.X, Y * other.Y);
+	}
+	constexpr FVector2i operator/(int32 divisor) const
+	{
+		return FVector2i(X / divisor, Y / divisor);
+	}
+	constexpr FVector2i operator/(const FVector2i& other) const
+	{
+		return FVector2i(X / other.X, Y / other.Y);
+	}
+	constexpr FVector2i operator+(const FVector2i& other) const
+	{
+		return FVector2i(X + other.X, Y + other.Y);
+	}
+	constexpr FVector2i operator-(const FVector2i& other) const
+	{
+		return FVector2i(X - other.X, Y - other.Y);
+	}
+	constexpr FVector2i operator-() const
+	{
+		return FVector2i(-X, -Y);
+	}
+	constexpr FVector2i operator+(int32 value) const
+	{
+		return FVector2i(X + value, Y + value);
+	}
+	constexpr FVector2i operator-(int32 value) const
+	{
+		return FVector2i(X - value, Y - value);
+	}
+
+	//   Vector3& operator*=(int32 scale);
+	//   Vector3& operator/=(int32 divisor);
+	//   Vector3& operator+=(const Vector3& other);
+	//   Vector3& operator-=(const Vector3& other);
+	//   Vector3& operator=(const Vector3& other);
+
+	constexpr bool IsZero() const
+	{
+		return X == 0 && Y == 0;
+	}
+
+	constexpr int32 Capacity() const
+	{
+		return X * Y;
+	}
+
+};
+
+using Vec2i = FVector2i;
+
+// size of a world when nothing else is asked for
+constexpr FVector2i gDefaultSize = FVector2i(256, 256);
+constexpr uint32 gGenomeSize = 64;
+using GeneType = uint8;
+using AgeType = uint16;
+
+using RotationType = uint8;
+constexpr RotationType gRotationsCount = 8;
+constexpr std::array<Vec2i, gRotationsCount> gRotations = { Vec2i(0, 1),  Vec2i(1, 1), Vec2i(1, 0), Vec2i(1, -1), Vec2i(0, -1), Vec2i(-1, -1), Vec2i(-1, 0), Vec2i(-1, 1) };
+
+// what lies past the edges of the world, a neighbour past a wall is the slot at the wall
+enum class ETopology : uint8
+{
+	// X wraps around, Y ends at walls
+	Cylinder,
+	// X and Y wrap around
+	Torus,
+	// walls on all four sides
+	Box,
+};
+
+enum EGene : GeneType
+{
+	Trash,
+	MoveForward,
+	MoveBackward,
+	RotateCCW,
+	RotateCW,
+	Photo,
+	Chemo,
+	Death,
+	EatForward,
+	Mitose,
+	GiveEnergy,
+	TakeEnergy,
+	Olding,
+	Regen,
+	Counter,
+	DetectFriend,
+	//DetectOther,
+	DetectEnergy,
+	EGene_MAX,
+};
+
+inline constexpr Vec2i IndexToCell(int32 i, const Vec2i &size)
+{
+	return Vec2i{ static_cast<int32>(i / size.Y),
+		static_cast<int32>(i % size.Y) };
+}
+
+inline constexpr bool IsPowerOfTwo(int32 value)
+{
+	return value > 0 && (value & (value - 1)) == 0;
+}
+
+// How the ticks split a slot index into its column and depth, they are templates over it.
+// DepthDivide fits every world, DepthShift worlds whose depth is a power of two, where the
+// split is a shift and a mask instead of a division.
+struct DepthDivide
+{
+	explicit DepthDivide(const Vec2i & size)
+		: Depth(size.Y)
+	{}
+
+	Vec2i ToCell(int32 index) const
+	{
+		return Vec2i(index / Depth, index % Depth);
+	}
+
+	const int32 Depth;
+};
+
+struct DepthShift
+{
+	explicit DepthShift(const Vec2i & size)
+		: Shift(Log2(size.Y))
+		, Mask(size.Y - 1)
+	{}
+
+	Vec2i ToCell(int32 index) const
+	{
+		return Vec2i(index >> Shift, index & Mask);
+	}
+
+	static int32 Log2(int32 value)
+	{
+		int32 shift = 0;
+		while ((1 << (shift + 1)) <= value)
+		{
+			++shift;
+		}
+		return shift;
+	}
+
+	const int32 Shift;
+	const int32 Mask;
+};
+
+inline constexpr int32 CellToIndex(const Vec2i &_pos, const Vec2i &size)
+{
+	auto pos = _pos;
+	/*if (pos.X >= size.X)
+	{
+		pos.X = pos.X - size.X;
+	}
+	if (pos.Y >= size.Y)
+	{
+		pos.Y = pos.Y - size.Y;
+	}
+	if (pos.X < 0)
+	{
+		pos.X = pos.X + size.X;
+	}
+	if (pos.Y < 0)
+	{
+		pos.Y = pos.Y + size.Y;
+	}*/
+
+	if (pos.X >= size.X)
+	{
+		pos.X = pos.X - size.X;
+	}
+	if (pos.Y >= size.Y)
+	{
+		pos.Y = size.Y - 1;
+	}
+	if (pos.X < 0)
+	{
+		pos.X = pos.X + size.X;
+	}
+	if (pos.Y < 0)
+	{
+		pos.Y = 0;
+	}
+
+	return static_cast<int32>(pos.X) * size.Y +
+		static_cast<int32>(pos.Y);
+}
+
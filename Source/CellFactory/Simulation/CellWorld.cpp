@@ -0,0 +1,500 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "CellWorld.h"
+
+#include <algorithm>
+
+bool CellRef::IsOther(const CellRef & /*other*/) const
+{
+	return true;
+}
+
+bool CellRef::IsDead() const
+{
+	return World.Dead[Index];
+}
+
+void CellRef::Kill()
+{
+	MarkDead();
+	World.Program[Index] = nullptr;
+	Speed = Vec2f(0);
+	accumulated_delta = {};
+	Rotation = 0;
+	Fingerprint = 0;
+	GeneDeviation = 0;
+}
+
+bool CellRef::IsEmpty() const
+{
+	return IsDead() && Energy <= 0;
+}
+
+void CellRef::MarkDead()
+{
+	World.Dead[Index] = true;
+}
+
+void CellRef::SetGene(int32 position, uint8 gene)
+{
+	std::array<uint8, gGenomeSize> genome = {};
+	uint64 fingerprint = 0;
+	if (Program)
+	{
+		genome = Program->Genome;
+		fingerprint = Program->Fingerprint;
+	}
+	else
+	{
+		fingerprint = GenomeFingerprint(genome);
+	}
+
+	const auto change = [&](int32 at, uint8 value)
+	{
+		fingerprint ^= GeneKey(at, genome[at]) ^ GeneKey(at, value);
+		genome[at] = value;
+	};
+
+	// the genome GetGenome would give, then the one byte
+	if (IsDead())
+	{
+		change(0, EGene::Death);
+	}
+	change(position, gene);
+
+	World.Program[Index] = World.Programs.Intern(genome, fingerprint);
+	World.Dead[Index] = genome[0] == EGene::Death;
+}
+
+void CellRef::SetGenome(const std::array<uint8, gGenomeSize> & arr)
+{
+	SetProgram(World.Programs.Intern(arr));
+}
+
+void CellRef::SetProgram(const GenomeProgram * program)
+{
+	World.Program[Index] = program;
+	World.Dead[Index] = program->Genome[0] == EGene::Death;
+	Fingerprint = program->Fingerprint;
+}
+
+std::array<uint8, gGenomeSize> CellRef::GetGenome() const
+{
+	std::array<uint8, gGenomeSize> genome = {};
+	if (Program)
+	{
+		genome = Program->Genome;
+	}
+	if (IsDead())
+	{
+		genome[0] = EGene::Death;
+	}
+
+	return genome;
+}
+
+CellRef & CellRef::operator = (const Cell & cell)
+{
+	SetGenome(cell.Genome);
+	Rotation = cell.Rotation;
+	Speed = cell.Speed;
+	Energy = cell.Energy;
+	Counter = cell.Counter;
+	Age = cell.Age;
+	Fingerprint = cell.Fingerprint;
+	GeneDeviation = cell.GeneDeviation;
+	FeedType = cell.FeedType;
+	accumulated_delta = cell.accumulated_delta;
+
+	return *this;
+}
+
+CellRef::operator Cell() const
+{
+	Cell cell;
+	cell.Genome = GetGenome();
+	cell.Rotation = Rotation;
+	cell.Speed = Speed;
+	cell.Energy = Energy;
+	cell.Counter = Counter;
+	cell.Age = Age;
+	cell.Fingerprint = Fingerprint;
+	cell.GeneDeviation = GeneDeviation;
+	cell.FeedType = FeedType;
+	cell.accumulated_delta = accumulated_delta;
+
+	return cell;
+}
+
+void CellWorld::Resize(const Vec2i & size, bool huge_pages)
+{
+	Size = size;
+	++Generation;
+
+	const int32 count = size.Capacity();
+	InActive.Allocate(count, huge_pages);
+	Program.Allocate(count, huge_pages);
+	Dead.Allocate(count, huge_pages);
+	Rotation.Allocate(count, huge_pages);
+	Speed.Allocate(count, huge_pages);
+	Energy.Allocate(count, huge_pages);
+	Counter.Allocate(count, huge_pages);
+	Age.Allocate(count, huge_pages);
+	Fingerprint.Allocate(count, huge_pages);
+	GeneDeviation.Allocate(count, huge_pages);
+	FeedType.Allocate(count, huge_pages);
+	accumulated_delta.Allocate(count, huge_pages);
+
+	SetTopology(Topology);
+
+	// the stamp keeps counting, so nothing that saw the old world takes new rows for old ones
+	RowStamp.assign(size.X, 0);
+	Programs.Reset();
+
+	ChunkList.clear();
+	AwakeChunks.clear();
+	SetChunkSize(ChunkSize);
+}
+
+void CellWorld::SetTopology(ETopology topology)
+{
+	Topology = topology;
+
+	// a step around an edge skips a whole row of columns or a whole column, one into a wall stays put
+	const bool wrap_x = topology != ETopology::Box;
+	const bool wrap_y = topology == ETopology::Torus;
+
+	ColumnSteps.resize(Size.X * gRotationsCount);
+	for (int32 x = 0; x < Size.X; ++x)
+	{
+		for (int32 r = 0; r < gRotationsCount; ++r)
+		{
+			const int32 nx = wrap_x ? (x + gRotations[r].X + Size.X) % Size.X : std::min(std::max(x + gRotations[r].X, 0), Size.X - 1);
+			ColumnSteps[x * gRotationsCount + r] = (nx - x) * Size.Y;
+		}
+	}
+
+	DepthSteps.resize(Size.Y * gRotationsCount);
+	for (int32 y = 0; y < Size.Y; ++y)
+	{
+		for (int32 r = 0; r < gRotationsCount; ++r)
+		{
+			const int32 ny = wrap_y ? (y + gRotations[r].Y + Size.Y) % Size.Y : std::min(std::max(y + gRotations[r].Y, 0), Size.Y - 1);
+			DepthSteps[y * gRotationsCount + r] = ny - y;
+		}
+	}
+}
+
+size_t CellWorld::GetColumnBytes() const
+{
+	const size_t slot = sizeof(bool) * 2 + sizeof(const GenomeProgram *) + sizeof(RotationType) + sizeof(Vec2f) * 2
+		+ sizeof(float) + sizeof(uint16) * 2 + sizeof(uint64) + sizeof(uint8) * 2;
+	return size_t(Num()) * slot;
+}
+
+void CellWorld::SetChunkSize(int32 edge)
+{
+	std::vector<int32> active;
+	for (auto chunk : AwakeChunks)
+	{
+		active.insert(active.end(), ChunkList[chunk].Active.begin(), ChunkList[chunk].Active.end());
+	}
+
+	// which slots the old chunks had touched does not map onto the new ones
+	bool touched = false;
+	for (const auto & chunk : ChunkList)
+	{
+		touched = touched || chunk.Touched;
+	}
+
+	ChunkSize = std::max(edge, 1);
+	Chunks = { (Size.X + ChunkSize - 1) / ChunkSize, (Size.Y + ChunkSize - 1) / ChunkSize };
+	ChunkList.assign(Chunks.Capacity(), CellChunk());
+	AwakeChunks.clear();
+
+	ChunkColumns.resize(Size.X);
+	for (int32 x = 0; x < Size.X; ++x)
+	{
+		ChunkColumns[x] = (x / ChunkSize) * Chunks.Y;
+	}
+	ChunkDepths.resize(Size.Y);
+	for (int32 y = 0; y < Size.Y; ++y)
+	{
+		ChunkDepths[y] = y / ChunkSize;
+	}
+
+	for (auto & chunk : ChunkList)
+	{
+		chunk.Touched = touched;
+	}
+
+	AddActive(active);
+}
+
+bool CellWorld::IsBlank(int32 index) const
+{
+	return Dead[index] && Energy[index] == -1 && !Program[index] && Rotation[index] == 0
+		&& Speed[index].X == 0 && Speed[index].Y == 0 && Counter[index] == 0 && Age[index] == 0
+		&& Fingerprint[index] == 0 && GeneDeviation[index] == 0 && FeedType[index] == 0
+		&& accumulated_delta[index].X == 0 && accumulated_delta[index].Y == 0;
+}
+
+void CellWorld::Swap(int32 a, int32 b)
+{
+	std::swap(Program[a], Program[b]);
+	std::swap(Dead[a], Dead[b]);
+	std::swap(Rotation[a], Rotation[b]);
+	std::swap(Speed[a], Speed[b]);
+	std::swap(Energy[a], Energy[b]);
+	std::swap(Counter[a], Counter[b]);
+	std::swap(Age[a], Age[b]);
+	std::swap(Fingerprint[a], Fingerprint[b]);
+	std::swap(GeneDeviation[a], GeneDeviation[b]);
+	std::swap(FeedType[a], FeedType[b]);
+	std::swap(accumulated_delta[a], accumulated_delta[b]);
+}
+
+void CellWorld::CompactActive(bool sort)
+{
+	++Stamp;
+
+	int32 awake = 0;
+	for (auto chunk_index : AwakeChunks)
+	{
+		auto & chunk = ChunkList[chunk_index];
+		auto & active = chunk.Active;
+
+		int32 kept = 0;
+		int32 live = 0;
+		for (int32 k = 0; k < static_cast<int32>(active.size()); ++k)
+		{
+			const int32 index = active[k];
+			RowStamp[index / Size.Y] = Stamp;
+
+			if (IsEmpty(index))
+			{
+				InActive[index] = false;
+				Program[index] = nullptr;
+			}
+			else
+			{
+				active[kept++] = index;
+				live += !Dead[index];
+			}
+		}
+		active.resize(kept);
+		chunk.Live = live;
+
+		if (kept == 0)
+		{
+			chunk.Awake = false;
+			continue;
+		}
+
+		if (sort)
+		{
+			std::sort(active.begin(), active.end());
+		}
+		AwakeChunks[awake++] = chunk_index;
+	}
+	AwakeChunks.resize(awake);
+
+	std::sort(AwakeChunks.begin(), AwakeChunks.end());
+}
+
+void CellWorld::TouchAll()
+{
+	++Stamp;
+	std::fill(RowStamp.begin(), RowStamp.end(), Stamp);
+}
+
+void CellWorld::ResetActive()
+{
+	for (auto chunk_index : AwakeChunks)
+	{
+		auto & chunk = ChunkList[chunk_index];
+		chunk.Active.clear();
+		chunk.Live = 0;
+		chunk.Awake = false;
+	}
+	AwakeChunks.clear();
+	InActive.fill(false);
+}
+
+int32 CellWorld::GetActiveCount() const
+{
+	int32 count = 0;
+	for (auto chunk : AwakeChunks)
+	{
+		count += static_cast<int32>(ChunkList[chunk].Active.size());
+	}
+	return count;
+}
+
+int32 CellWorld::GetLiveCount() const
+{
+	int32 count = 0;
+	for (auto chunk : AwakeChunks)
+	{
+		count += ChunkList[chunk].Live;
+	}
+	return count;
+}
+
+void CellWorld::CollectPrograms()
+{
+	if (!Programs.ShouldCollect())
+	{
+		return;
+	}
+
+	// after CompactActive every cell holding a program is in the active list of an awake chunk
+	for (auto chunk : AwakeChunks)
+	{
+		for (auto index : ChunkList[chunk].Active)
+		{
+			if (Program[index])
+			{
+				Program[index]->Marked = true;
+			}
+		}
+	}
+
+	Programs.Sweep();
+}
+
+GenomeProgram::GenomeProgram(const std::array<uint8, gGenomeSize> & genome, uint64 fingerprint)
+	: Genome(genome)
+	, Fingerprint(fingerprint)
+{
+	for (uint32 position = 0; position < gGenomeSize; ++position)
+	{
+		auto & op = Ops[position];
+
+		const auto i_param1 = genome[(position + 1) % gGenomeSize];
+		const auto i_param2 = genome[(position + 2) % gGenomeSize];
+
+		op.Gene = genome[position] < EGene::EGene_MAX ? static_cast<EGene>(genome[position]) : EGene::Trash;
+		op.RawParam1 = i_param1;
+		op.Param1 = i_param1 / float(std::numeric_limits<GeneType>::max());
+		op.Param2 = i_param2 / float(std::numeric_limits<GeneType>::max());
+		++GeneCounts[op.Gene];
+
+		switch (op.Gene)
+		{
+		case EGene::MoveForward:
+		case EGene::Photo:
+		case EGene::Chemo:
+			op.Advance = 1;
+			break;
+
+		case EGene::Olding:
+		case EGene::RotateCW:
+		case EGene::RotateCCW:
+		case EGene::Regen:
+			op.Advance = 2;
+			break;
+
+		case EGene::Mitose:
+		case EGene::GiveEnergy:
+		case EGene::TakeEnergy:
+			op.Advance = 3;
+			break;
+
+		case EGene::Counter:
+			op.Jump = i_param1;
+			break;
+
+		// a taken jump still skips the gene and its two parameters
+		case EGene::DetectFriend:
+		case EGene::Death:
+		case EGene::DetectEnergy:
+			op.Advance = 3;
+			op.Jump = i_param2 + 3;
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+const GenomeProgram * GenomeCache::Intern(const std::array<uint8, gGenomeSize> & genome)
+{
+	return Intern(genome, GenomeFingerprint(genome));
+}
+
+const GenomeProgram * GenomeCache::Intern(const std::array<uint8, gGenomeSize> & genome, uint64 fingerprint)
+{
+	std::lock_guard<std::mutex> lock(Lock);
+
+	const auto range = Programs.equal_range(fingerprint);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second->Genome == genome)
+		{
+			return it->second.get();
+		}
+	}
+
+	auto program = std::make_unique<GenomeProgram>(genome, fingerprint);
+	const GenomeProgram * interned = program.get();
+	Programs.emplace(fingerprint, std::move(program));
+	return interned;
+}
+
+void GenomeCache::GetTopSpecies(int32 count, std::vector<const GenomeProgram *> & out) const
+{
+	count = std::max(count, 0);
+
+	out.clear();
+	for (const auto & entry : Programs)
+	{
+		if (entry.second->Population > 0)
+		{
+			out.push_back(entry.second.get());
+		}
+	}
+
+	const auto more = [](const GenomeProgram * a, const GenomeProgram * b)
+	{
+		return a->Population > b->Population;
+	};
+
+	if (count < static_cast<int32>(out.size()))
+	{
+		std::nth_element(out.begin(), out.begin() + count, out.end(), more);
+		out.resize(count);
+	}
+	std::sort(out.begin(), out.end(), more);
+}
+
+void GenomeCache::Sweep()
+{
+	for (auto it = Programs.begin(); it != Programs.end();)
+	{
+		if (it->second->Marked)
+		{
+			it->second->Marked = false;
+			++it;
+		}
+		else
+		{
+			it = Programs.erase(it);
+		}
+	}
+
+	CollectAt = std::max<size_t>(1024, Programs.size() * 2);
+}
+
+void GenomeCache::Reset()
+{
+	Programs.clear();
+	CollectAt = 1024;
+}
+
+void Cell::SetGenome(std::array<uint8, gGenomeSize> arr)
+{
+	Genome = arr;
+	Fingerprint = GenomeFingerprint(arr);
+}
\ No newline at end of file
@@ -0,0 +1,408 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "AlignedArray.h"
+#include "CellTypes.h"
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// One genome position decoded ahead of time: the opcode, its two parameter bytes
+// already scaled to [0, 1] and where the counter goes next.
+struct GeneOp
+{
+	EGene Gene = EGene::Trash;
+	uint8 RawParam1 = 0;
+	// counter step when the gene does not jump
+	uint16 Advance = 0;
+	// counter value after a taken jump (Counter, DetectFriend, DetectEnergy)
+	uint16 Jump = 0;
+	float Param1 = 0;
+	float Param2 = 0;
+};
+
+// Key of one genome byte at one position. The fingerprint of a genome is the xor of the
+// keys of all its bytes, so changing one byte moves it by two keys instead of a rehash.
+inline uint64 GeneKey(uint32 position, uint8 gene)
+{
+	// splitmix64 finalizer
+	uint64 key = ((uint64(position) << 8) | gene) * 0x9E3779B97F4A7C15ULL;
+	key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+	return key ^ (key >> 31);
+}
+
+inline uint64 GenomeFingerprint(const std::array<uint8, gGenomeSize> & genome)
+{
+	uint64 fingerprint = 0;
+	for (uint32 position = 0; position < gGenomeSize; ++position)
+	{
+		fingerprint ^= GeneKey(position, genome[position]);
+	}
+	return fingerprint;
+}
+
+// Decoded form of one genome, built once and shared by every cell carrying that genome.
+// Every distinct genome is a species, its program also counts the live cells carrying it.
+class GenomeProgram
+{
+
+public:
+
+	GenomeProgram(const std::array<uint8, gGenomeSize> & genome, uint64 fingerprint);
+
+	std::array<uint8, gGenomeSize> Genome;
+	std::array<GeneOp, gGenomeSize> Ops;
+
+	// GenomeFingerprint of Genome
+	uint64 Fingerprint = 0;
+
+	// how often every gene occurs, bytes past the last gene count as Trash
+	std::array<uint8, EGene_MAX> GeneCounts = {};
+
+	// live cells carrying the genome, kept by PopulationStats from any worker
+	mutable std::atomic<int32> Population{ 0 };
+
+	// set by GenomeCache::Sweep callers for programs still in use
+	mutable bool Marked = false;
+};
+
+// Interns genomes into shared GenomeProgram instances keyed by their fingerprint.
+class GenomeCache
+{
+
+public:
+
+	// thread safe, workers of the parallel tick intern mutated genomes
+	const GenomeProgram * Intern(const std::array<uint8, gGenomeSize> & genome);
+
+	// Intern for a genome whose fingerprint is already known, as after changing one byte
+	const GenomeProgram * Intern(const std::array<uint8, gGenomeSize> & genome, uint64 fingerprint);
+
+	// Up to count programs with the most live cells, most first. Goes over the species
+	// only, never the world. Not for use while a step runs.
+	void GetTopSpecies(int32 count, std::vector<const GenomeProgram *> & out) const;
+
+	// worth marking live programs and sweeping the rest
+	bool ShouldCollect() const
+	{
+		return Programs.size() >= CollectAt;
+	}
+
+	// frees every program not marked since the last sweep and clears the marks
+	void Sweep();
+
+	void Reset();
+
+private:
+
+	std::mutex Lock;
+	// by fingerprint, distinct genomes sharing one are told apart by their bytes
+	std::unordered_multimap<uint64, std::unique_ptr<GenomeProgram>> Programs;
+	size_t CollectAt = 1024;
+};
+
+// Plain value of one cell, used to build cells before they are stored in a CellWorld.
+class Cell
+{
+
+public:
+
+	std::array<uint8, gGenomeSize> Genome;
+
+	RotationType Rotation = 0;
+	Vec2f Speed = {};
+	float Energy = 0;
+	uint16 Counter = 0;
+	uint16 Age = 0;
+	uint64 Fingerprint = 0;
+	uint8 GeneDeviation = 0;
+	uint8 FeedType = 0;
+
+	Vec2f accumulated_delta;
+
+	void SetGenome(std::array<uint8, gGenomeSize> arr);
+};
+
+class CellWorld;
+
+// A square block of the grid with its own active list. A chunk whose list is empty
+// sleeps: it is off CellWorld::AwakeChunks and passes never look at it.
+struct CellChunk
+{
+	// live and decaying cells of the chunk, the only slots Tick visits
+	std::vector<int32> Active;
+
+	// cells of Active that are not dead, as of the last compaction
+	int32 Live = 0;
+
+	bool Awake = false;
+
+	// Had an active cell since the world was made. Slots of untouched chunks are still
+	// blank, emptied slots elsewhere keep what their last cell left behind.
+	bool Touched = false;
+};
+
+// View of one slot of a CellWorld. The fields refer straight into the world columns,
+// so it reads like a Cell & while every field lives in its own contiguous array.
+// The genome is shared through Program and read-only here: gene writes go through
+// SetGene/SetGenome/SetProgram/MarkDead so the dead flag stays in sync.
+class CellRef
+{
+
+public:
+
+	CellRef(CellWorld & world, int32 index);
+
+	const GenomeProgram * const & Program;
+
+	RotationType & Rotation;
+	Vec2f & Speed;
+	float & Energy;
+	uint16 & Counter;
+	uint16 & Age;
+	uint64 & Fingerprint;
+	uint8 & GeneDeviation;
+	uint8 & FeedType;
+
+	Vec2f & accumulated_delta;
+
+	// same species, one compare of the fingerprints
+	bool IsFriend(const CellRef & other) const
+	{
+		return Fingerprint == other.Fingerprint;
+	}
+
+	bool IsOther(const CellRef & other) const;
+	bool IsDead() const;
+	void Kill();
+	bool IsEmpty() const;
+	// same as writing EGene::Death to Genome[0], without interning a new genome
+	void MarkDead();
+	void SetGene(int32 position, uint8 gene);
+	void SetGenome(const std::array<uint8, gGenomeSize> & arr);
+	void SetProgram(const GenomeProgram * program);
+	std::array<uint8, gGenomeSize> GetGenome() const;
+
+	int32 GetIndex() const
+	{
+		return Index;
+	}
+
+	CellRef & operator = (const Cell & cell);
+	operator Cell() const;
+
+private:
+
+	CellWorld & World;
+	int32 Index;
+};
+
+// Structure-of-arrays storage for the whole grid. Every cell field has its own column,
+// so scanning passes only pull the bytes they check (Dead and Energy for IsEmpty)
+// instead of the whole ~100 byte cell. Columns are sized at runtime and cache-line
+// aligned, large ones may sit on huge pages.
+class CellWorld
+{
+
+public:
+
+	// Reallocates every column for a world of size, all slots empty and nothing active.
+	// Size.X * Size.Y has to fit an int32.
+	void Resize(const Vec2i & size, bool huge_pages);
+
+	// Splits the grid into chunks of edge x edge cells (the last row and column may be
+	// smaller) and refiles the active cells into them.
+	void SetChunkSize(int32 edge);
+
+	int32 GetChunk(const Vec2i & pos) const
+	{
+		return ChunkColumns[pos.X] + ChunkDepths[pos.Y];
+	}
+
+	int32 GetChunk(int32 index) const
+	{
+		return GetChunk(IndexToCell(index, Size));
+	}
+
+	int32 Num() const
+	{
+		return Size.Capacity();
+	}
+
+	// memory held by the columns
+	size_t GetColumnBytes() const;
+
+	Vec2i Size = {};
+
+	// counts the Resize calls, copies of the world tell by it that their rows mean nothing now
+	uint32 Generation = 0;
+
+	// what GetNeighbor finds past the edges, cells stay where they are
+	void SetTopology(ETopology topology);
+
+	ETopology Topology = ETopology::Cylinder;
+
+	// The slot next to the one at index and pos in direction rotation (into gRotations),
+	// across the edges as Topology has it. The edges are folded into steps by column and
+	// by depth that Resize and SetTopology make, so no slot takes a branch.
+	int32 GetNeighbor(int32 index, const Vec2i & pos, uint32 rotation) const
+	{
+		rotation %= gRotationsCount;
+		return index + ColumnSteps[pos.X * gRotationsCount + rotation] + DepthSteps[pos.Y * gRotationsCount + rotation];
+	}
+
+	CellRef operator [] (int32 index)
+	{
+		return CellRef(*this, index);
+	}
+
+	bool IsDead(int32 index) const
+	{
+		return Dead[index];
+	}
+
+	bool IsEmpty(int32 index) const
+	{
+		return Dead[index] && Energy[index] <= 0;
+	}
+
+	// an empty slot as Repopulate leaves it, without traces of an earlier cell
+	bool IsBlank(int32 index) const;
+
+	void Swap(int32 a, int32 b);
+
+	// Tracks a slot that may have become non-empty, waking its chunk
+	void Activate(int32 index)
+	{
+		if (!InActive[index])
+		{
+			InActive[index] = true;
+			AddToChunk(index, GetChunk(index));
+		}
+	}
+
+	// Activate for use during a pass: new slots are collected in pending and only reach
+	// their chunks through AddActive once the pass is done
+	void Activate(int32 index, std::vector<int32> & pending)
+	{
+		if (!InActive[index])
+		{
+			InActive[index] = true;
+			pending.push_back(index);
+		}
+	}
+
+	void AddActive(const std::vector<int32> & pending)
+	{
+		AddActive(pending, DepthDivide(Size));
+	}
+
+	// for the ticks, which split the indices by their Layout (DepthDivide or DepthShift)
+	template <typename Layout>
+	void AddActive(const std::vector<int32> & pending, const Layout & layout)
+	{
+		for (auto index : pending)
+		{
+			AddToChunk(index, GetChunk(layout.ToCell(index)));
+		}
+	}
+
+	// Drops slots that went empty since the last call, optionally sorting the rest by index,
+	// and puts chunks left without any to sleep. Every slot changed since the previous call
+	// is still listed here, so this is also where the texture rows they fall into get stamped.
+	void CompactActive(bool sort);
+
+	// stamps every texture row, for changes that do not go through the active list
+	void TouchAll();
+
+	void ResetActive();
+
+	// live and decaying cells over all chunks
+	int32 GetActiveCount() const;
+
+	// live cells over all chunks, as of the last compaction
+	int32 GetLiveCount() const;
+
+	int32 ChunkSize = 32;
+	Vec2i Chunks = {};
+	std::vector<CellChunk> ChunkList;
+
+	// chunks with active cells, in index order after a compaction
+	std::vector<int32> AwakeChunks;
+
+	// first chunk of every column and chunk offset of every depth, GetChunk adds them
+	std::vector<int32> ChunkColumns;
+	std::vector<int32> ChunkDepths;
+
+	// index steps to the neighbours, gRotationsCount per column and per depth
+	std::vector<int32> ColumnSteps;
+	std::vector<int32> DepthSteps;
+
+	AlignedArray<bool> InActive;
+
+	// Stamp of the last compaction that changed a lens texture row (index / Size.Y, one
+	// row per X), lens textures upload only rows stamped after their previous upload
+	std::vector<uint32> RowStamp;
+	uint32 Stamp = 0;
+
+	// marks programs of active cells and frees the rest once the cache has grown
+	void CollectPrograms();
+
+	GenomeCache Programs;
+
+	// null for killed cells
+	AlignedArray<const GenomeProgram *> Program;
+
+	// Genome[0] == EGene::Death, kept apart so the liveness check never touches the genome
+	// and dying does not need a genome of its own
+	AlignedArray<bool> Dead;
+
+	AlignedArray<RotationType> Rotation;
+	AlignedArray<Vec2f> Speed;
+	AlignedArray<float> Energy;
+	AlignedArray<uint16> Counter;
+	AlignedArray<uint16> Age;
+	// Fingerprint of the genome the cell was born with or last rehashed to, which is what
+	// makes two cells friends. Mutations without a rehash leave it behind the genome.
+	AlignedArray<uint64> Fingerprint;
+	AlignedArray<uint8> GeneDeviation;
+	AlignedArray<uint8> FeedType;
+
+	AlignedArray<Vec2f> accumulated_delta;
+
+private:
+
+	void AddToChunk(int32 index, int32 chunk_index)
+	{
+		auto & chunk = ChunkList[chunk_index];
+		chunk.Active.push_back(index);
+		chunk.Touched = true;
+		if (!chunk.Awake)
+		{
+			chunk.Awake = true;
+			AwakeChunks.push_back(chunk_index);
+		}
+	}
+};
+
+inline CellRef::CellRef(CellWorld & world, int32 index)
+	: Program(world.Program[index])
+	, Rotation(world.Rotation[index])
+	, Speed(world.Speed[index])
+	, Energy(world.Energy[index])
+	, Counter(world.Counter[index])
+	, Age(world.Age[index])
+	, Fingerprint(world.Fingerprint[index])
+	, GeneDeviation(world.GeneDeviation[index])
+	, FeedType(world.FeedType[index])
+	, accumulated_delta(world.accumulated_delta[index])
+	, World(world)
+	, Index(index)
+{}
+
@@ -0,0 +1,167 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "CompactWorld.h"
+#include "CellWorld.h"
+#include "PopulationStats.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+constexpr uint32 gGenomeIdBits = 24;
+constexpr uint32 gGenomeIdMask = (1u << gGenomeIdBits) - 1;
+
+constexpr float gSpeedScale = 256.f;
+constexpr float gDeltaScale = 32.f;
+
+static_assert(gGenomeSize == 64 && gRotationsCount == 8, "CompactCell::State holds 6 bits of Counter and 3 of Rotation");
+
+template <typename Fixed>
+static Fixed ToFixed(float value, float scale)
+{
+	const float low = std::numeric_limits<Fixed>::min();
+	const float high = std::numeric_limits<Fixed>::max();
+
+	const float scaled = value * scale;
+	if (!(scaled > low))
+	{
+		// NaN compares false both ways and ends up as 0
+		return scaled <= low ? std::numeric_limits<Fixed>::min() : Fixed(0);
+	}
+	if (scaled >= high)
+	{
+		return std::numeric_limits<Fixed>::max();
+	}
+	return static_cast<Fixed>(std::lround(scaled));
+}
+
+static uint16 ToHalfFloat(float value)
+{
+	uint32 bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	// NaN stays NaN, the rounding could carry its payload into infinity
+	if ((bits & 0x7FFFFFFF) > 0x7F800000)
+	{
+		return static_cast<uint16>((bits >> 16) | 0x40);
+	}
+	bits += 0x7FFF + ((bits >> 16) & 1);
+	return static_cast<uint16>(bits >> 16);
+}
+
+static float FromHalfFloat(uint16 half)
+{
+	const uint32 bits = uint32(half) << 16;
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+bool CompactWorld::Pack(const CellWorld & world, bool huge_pages)
+{
+	Size = world.Size;
+	Genomes.clear();
+
+	const int32 count = world.Num();
+	Cells.Allocate(count, huge_pages);
+
+	std::unordered_map<const GenomeProgram *, uint32> ids;
+	for (int32 index = 0; index < count; ++index)
+	{
+		const GenomeProgram * program = world.Program[index];
+
+		uint32 id = 0;
+		if (program)
+		{
+			auto found = ids.find(program);
+			if (found == ids.end())
+			{
+				if (Genomes.size() >= gGenomeIdMask)
+				{
+					Size = {};
+					Cells.Release();
+					Genomes.clear();
+					return false;
+				}
+				Genomes.push_back(program->Genome);
+				found = ids.emplace(program, static_cast<uint32>(Genomes.size())).first;
+			}
+			id = found->second;
+		}
+
+		CompactCell & cell = Cells[index];
+		cell.GenomeAndDeviation = id | (uint32(world.GeneDeviation[index]) << gGenomeIdBits);
+		cell.Speed[0] = ToFixed<int16>(world.Speed[index].X, gSpeedScale);
+		cell.Speed[1] = ToFixed<int16>(world.Speed[index].Y, gSpeedScale);
+		cell.Delta[0] = ToFixed<int8>(world.accumulated_delta[index].X, gDeltaScale);
+		cell.Delta[1] = ToFixed<int8>(world.accumulated_delta[index].Y, gDeltaScale);
+		cell.Energy = ToHalfFloat(world.Energy[index]);
+		cell.Age = world.Age[index];
+		cell.State = static_cast<uint16>((world.Counter[index] % gGenomeSize)
+			| ((world.Rotation[index] % gRotationsCount) << 6)
+			| (uint32(world.Dead[index]) << 9)
+			| (std::min<uint32>(world.FeedType[index], 7) << 10));
+	}
+
+	return true;
+}
+
+void CompactWorld::Unpack(CellWorld & world, bool huge_pages, bool sort_active) const
+{
+	world.Resize(Size, huge_pages);
+	world.TouchAll();
+
+	std::vector<const GenomeProgram *> programs(Genomes.size() + 1, nullptr);
+	for (size_t g = 0; g < Genomes.size(); ++g)
+	{
+		programs[g + 1] = world.Programs.Intern(Genomes[g]);
+	}
+
+	const int32 count = world.Num();
+	for (int32 index = 0; index < count; ++index)
+	{
+		const CompactCell & cell = Cells[index];
+
+		const uint32 id = cell.GenomeAndDeviation & gGenomeIdMask;
+		const GenomeProgram * program = id < programs.size() ? programs[id] : nullptr;
+		world.Program[index] = program;
+		world.Fingerprint[index] = program ? program->Fingerprint : 0;
+		world.GeneDeviation[index] = static_cast<uint8>(cell.GenomeAndDeviation >> gGenomeIdBits);
+		world.Speed[index] = Vec2f(cell.Speed[0] / gSpeedScale, cell.Speed[1] / gSpeedScale);
+		world.accumulated_delta[index] = Vec2f(cell.Delta[0] / gDeltaScale, cell.Delta[1] / gDeltaScale);
+		world.Energy[index] = FromHalfFloat(cell.Energy);
+		world.Age[index] = cell.Age;
+		world.Counter[index] = cell.State & 63;
+		world.Rotation[index] = static_cast<RotationType>((cell.State >> 6) & 7);
+		// a live cell without a genome could not run, it comes back as a corpse
+		world.Dead[index] = ((cell.State >> 9) & 1) != 0 || !program;
+		world.FeedType[index] = static_cast<uint8>((cell.State >> 10) & 7);
+
+		if (!world.IsBlank(index))
+		{
+			world.ChunkList[world.GetChunk(index)].Touched = true;
+		}
+		if (!world.IsEmpty(index))
+		{
+			world.Activate(index);
+		}
+	}
+
+	world.CompactActive(sort_active);
+}
+
+size_t CompactWorld::GetBytes() const
+{
+	return size_t(Size.Capacity()) * sizeof(CompactCell) + Genomes.size() * gGenomeSize;
+}
+
+void CellSimulation::LoadCompact(const CompactWorld & compact)
+{
+	Parameters.WorldSize = compact.Size;
+	compact.Unpack(mArray, Parameters.HugePages, Parameters.SortActiveCells);
+	mArray.SetChunkSize(GetTileSize());
+	Stats = CountPopulation(mArray);
+}
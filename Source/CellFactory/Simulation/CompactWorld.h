@@ -0,0 +1,64 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "AlignedArray.h"
+#include "CellTypes.h"
+
+#include <array>
+#include <vector>
+
+class CellWorld;
+
+// One slot of a CompactWorld in 16 bytes, where the CellWorld columns take 45. Rotation
+// keeps only what is read of it, modulo gRotationsCount, and Fingerprint follows from the
+// genome. Counter keeps only the gene it points at, modulo gGenomeSize; the interpreter
+// compares the whole counter to tell a jump from a gene that left it alone, so a decoded
+// cell can take another path through its genome, not only run on rounded values.
+struct CompactCell
+{
+	// index + 1 into CompactWorld::Genomes (0 for none) in the low 24 bits, GeneDeviation on top
+	uint32 GenomeAndDeviation = 0;
+
+	// Speed in 8.8 fixed point, saturated
+	int16 Speed[2] = {};
+
+	// accumulated_delta in 3.5 fixed point, saturated
+	int8 Delta[2] = {};
+
+	// Energy as the upper half of its float (bfloat16), rounded to nearest
+	uint16 Energy = 0;
+
+	uint16 Age = 0;
+
+	// Counter % gGenomeSize in bits 0-5, Rotation % gRotationsCount in 6-8, Dead in 9,
+	// FeedType in 10-12
+	uint16 State = 0;
+};
+
+static_assert(sizeof(CompactCell) == 16, "a compact cell is 16 bytes");
+
+// Quantized copy of a whole CellWorld for very large worlds, every slot including the
+// empty ones, with each distinct genome stored once. Decoding gives a world that runs
+// on like the original, but speeds, offsets and energies are rounded, so it is not the
+// same world step for step.
+class CompactWorld
+{
+
+public:
+
+	// Encodes world. Fails and leaves the copy empty only when the world holds more
+	// genomes than a 24-bit index reaches.
+	bool Pack(const CellWorld & world, bool huge_pages);
+
+	// Replaces world with the decoded slots, resized to Size and with its active lists
+	// rebuilt, chunks keep the world's chunk size.
+	void Unpack(CellWorld & world, bool huge_pages, bool sort_active) const;
+
+	// memory held by the copy
+	size_t GetBytes() const;
+
+	Vec2i Size = {};
+	AlignedArray<CompactCell> Cells;
+	std::vector<std::array<uint8, gGenomeSize>> Genomes;
+};
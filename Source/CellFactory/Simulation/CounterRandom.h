@@ -0,0 +1,165 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+
+// Counter based generator (Philox4x32-10): every block of four numbers is a pure function
+// of the key and a 128-bit counter, nothing is carried from one draw to the next. A number
+// is addressed by stream and position, so cells can draw in any order and on any thread
+// and still get the same numbers.
+class CounterRandom
+{
+
+public:
+
+	CounterRandom() = default;
+
+	explicit CounterRandom(int32 seed)
+	{
+		Initialize(seed);
+	}
+
+	void Initialize(int32 seed)
+	{
+		Seed = seed;
+	}
+
+	int32 GetSeed() const
+	{
+		return Seed;
+	}
+
+	// numbers position * 4 to position * 4 + 3 of stream
+	void Block(uint64 stream, uint64 position, uint32 out[4]) const
+	{
+		uint32 c0 = static_cast<uint32>(position);
+		uint32 c1 = static_cast<uint32>(position >> 32);
+		uint32 c2 = static_cast<uint32>(stream);
+		uint32 c3 = static_cast<uint32>(stream >> 32);
+		uint32 k0 = static_cast<uint32>(Seed);
+		uint32 k1 = 0x5EED5EEDU;
+
+		for (int32 round = 0; round < 10; ++round)
+		{
+			const uint64 product0 = uint64(0xD2511F53U) * c0;
+			const uint64 product1 = uint64(0xCD9E8D57U) * c2;
+
+			c0 = static_cast<uint32>(product1 >> 32) ^ c1 ^ k0;
+			c1 = static_cast<uint32>(product1);
+			c2 = static_cast<uint32>(product0 >> 32) ^ c3 ^ k1;
+			c3 = static_cast<uint32>(product0);
+
+			k0 += 0x9E3779B9U;
+			k1 += 0xBB67AE85U;
+		}
+
+		out[0] = c0;
+		out[1] = c1;
+		out[2] = c2;
+		out[3] = c3;
+	}
+
+	// count numbers of stream from number first on
+	void Fill(uint64 stream, uint64 first, uint32 * out, int32 count) const
+	{
+		Generate(stream, first, count, [out](int32 k, uint32 value)
+		{
+			out[k] = value;
+		});
+	}
+
+	// the same numbers as Fill, as fractions in [0, 1)
+	void FillFractions(uint64 stream, uint64 first, float * out, int32 count) const
+	{
+		Generate(stream, first, count, [out](int32 k, uint32 value)
+		{
+			out[k] = ToFraction(value);
+		});
+	}
+
+	// 24 bits, every result is exact in a float
+	static float ToFraction(uint32 value)
+	{
+		return (value >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// [0, max), exact for any max unlike scaling a fraction
+	static int32 ToRange(uint32 value, int32 max)
+	{
+		return max > 0 ? static_cast<int32>((uint64(value) * uint32(max)) >> 32) : 0;
+	}
+
+private:
+
+	template <typename Store>
+	void Generate(uint64 stream, uint64 first, int32 count, const Store & store) const
+	{
+		uint32 block[4];
+		uint64 position = first / 4;
+		int32 skip = static_cast<int32>(first % 4);
+
+		for (int32 k = 0; k < count; ++position, skip = 0)
+		{
+			Block(stream, position, block);
+			for (int32 b = skip; b < 4 && k < count; ++b, ++k)
+			{
+				store(k, block[b]);
+			}
+		}
+	}
+
+	int32 Seed = 0;
+};
+
+// The numbers one cell draws in one step, the blocks from index << 32 on of the step's
+// stream, computed one at a time as they are used. Cheap to create, cells that draw nothing
+// cost nothing.
+class CellRandom
+{
+
+public:
+
+	CellRandom(const CounterRandom & random, uint64 stream, uint32 index)
+		: Random(random)
+		, Stream(stream)
+		, Position(uint64(index) << 32)
+	{}
+
+	uint32 GetUnsignedInt()
+	{
+		if (Used == 4)
+		{
+			Random.Block(Stream, Position++, Numbers);
+			Used = 0;
+		}
+		return Numbers[Used++];
+	}
+
+	// [0, 1)
+	float GetFraction()
+	{
+		return CounterRandom::ToFraction(GetUnsignedInt());
+	}
+
+	// [0, max)
+	int32 RandHelper(int32 max)
+	{
+		return CounterRandom::ToRange(GetUnsignedInt(), max);
+	}
+
+	// [min, max]
+	int32 RandRange(int32 min, int32 max)
+	{
+		return min + RandHelper((max - min) + 1);
+	}
+
+private:
+
+	const CounterRandom & Random;
+	const uint64 Stream;
+	uint64 Position;
+
+	uint32 Numbers[4];
+	int32 Used = 4;
+};
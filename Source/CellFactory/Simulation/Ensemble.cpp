@@ -0,0 +1,50 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "Ensemble.h"
+#include "Parallel.h"
+
+#include <chrono>
+#include <memory>
+
+std::vector<EnsembleResult> RunEnsemble(const std::vector<EnsembleRun> & runs, int32 ticks, int32 acceleration,
+	const std::function<void(int32 run, const EnsembleResult & result)> & done)
+{
+	std::vector<EnsembleResult> results(runs.size());
+
+	RunParallel(static_cast<int32>(runs.size()), [&](int32 k)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		// a world is several MB of columns, only the ones being run are alive
+		auto simulation = std::make_unique<CellSimulation>();
+		simulation->Parameters = runs[k].Parameters;
+		simulation->Parameters.ParallelTick = false;
+		simulation->Reset(runs[k].Seed);
+
+		auto & result = results[k];
+		result.SurvivalTicks = ticks;
+		for (int32 tick = 0; tick < ticks; ++tick)
+		{
+			simulation->Run(acceleration);
+
+			if (simulation->Repopulations > result.Extinctions)
+			{
+				if (result.Extinctions == 0)
+				{
+					result.SurvivalTicks = tick;
+				}
+				result.Extinctions = simulation->Repopulations;
+			}
+		}
+
+		result.Final = simulation->Stats;
+		result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (done)
+		{
+			done(k, result);
+		}
+	});
+
+	return results;
+}
@@ -0,0 +1,37 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "PopulationStats.h"
+#include "Simulation.h"
+
+#include <functional>
+#include <vector>
+
+// One world of an ensemble: the parameters it runs with and the seed it starts from
+struct EnsembleRun
+{
+	SimulationParameters Parameters;
+	int32 Seed = 0;
+};
+
+// How one world of an ensemble did
+struct EnsembleResult
+{
+	// ticks until life first died out and the world was repopulated, all of them if never
+	int32 SurvivalTicks = 0;
+	int32 Extinctions = 0;
+
+	// the population statistics after the last tick
+	PopulationStats Final;
+
+	double Seconds = 0;
+};
+
+// Runs every world for ticks ticks of acceleration steps, a tick being what ACellActor does
+// per frame. Worlds are independent, they are handed out to RunParallel one at a time so
+// a fast world frees its thread for the next one. Each world ticks serially, the result of
+// a run only depends on its parameters and seed. done is called after each world, from
+// whichever thread ran it.
+std::vector<EnsembleResult> RunEnsemble(const std::vector<EnsembleRun> & runs, int32 ticks, int32 acceleration,
+	const std::function<void(int32 run, const EnsembleResult & result)> & done = nullptr);
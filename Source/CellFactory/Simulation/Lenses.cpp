@@ -0,0 +1,150 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "Lenses.h"
+#include "Simulation.h"
+#include "WorldView.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+LenseSource GetLenseSource(const CellSimulation & simulation, std::vector<float> & light, std::vector<float> & chemo)
+{
+	const CellWorld & world = simulation.mArray;
+
+	light.resize(world.Size.Y);
+	chemo.resize(world.Size.Y);
+	for (int32 depth = 0; depth < world.Size.Y; ++depth)
+	{
+		light[depth] = simulation.GetLight(depth);
+		chemo[depth] = simulation.GetChemo(depth);
+	}
+
+	LenseSource source;
+	source.Size = world.Size;
+	source.Energy = world.Energy.data();
+	source.Dead = world.Dead.data();
+	source.FeedType = world.FeedType.data();
+	source.Fingerprint = world.Fingerprint.data();
+	source.RowStamp = world.RowStamp.data();
+	source.Stamp = world.Stamp;
+	source.Light = light.data();
+	source.Chemo = chemo.data();
+	return source;
+}
+
+LenseSource GetLenseSource(const WorldView & view)
+{
+	LenseSource source;
+	source.Size = view.Size;
+	source.Energy = view.Energy.data();
+	source.Dead = view.Dead.data();
+	source.FeedType = view.FeedType.data();
+	source.Fingerprint = view.Fingerprint.data();
+	source.RowStamp = view.RowStamp.data();
+	source.Stamp = view.Stamp;
+	source.Light = view.Light.data();
+	source.Chemo = view.Chemo.data();
+	return source;
+}
+
+void FillEnergyPixels(const LenseSource & source, int32 first, int32 count, uint32 * out)
+{
+	const float * energy = source.Energy + first;
+	const bool * dead = source.Dead + first;
+
+	int32 p = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 hundred = _mm_set1_ps(100.f);
+	const __m128 full = _mm_set1_ps(255.f);
+	const __m128i blue = _mm_set1_epi32(0xff);
+	const __m128i green = _mm_set1_epi32(0xff00);
+
+	for (; p + 4 <= count; p += 4)
+	{
+		const __m128 e = _mm_loadu_ps(energy + p);
+
+		int32 dead4;
+		std::memcpy(&dead4, dead + p, 4);
+		const __m128i dead_bytes = _mm_cvtsi32_si128(dead4);
+		const __m128i dead_lanes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(dead_bytes, _mm_setzero_si128()), _mm_setzero_si128());
+		const __m128i dead_mask = _mm_cmpgt_epi32(dead_lanes, _mm_setzero_si128());
+
+		const __m128i corpse_mask = _mm_and_si128(dead_mask, _mm_castps_si128(_mm_cmpgt_ps(e, zero)));
+		const __m128 level = _mm_mul_ps(_mm_div_ps(_mm_min_ps(_mm_max_ps(e, zero), hundred), hundred), full);
+		const __m128i red = _mm_slli_epi32(_mm_cvttps_epi32(level), 16);
+
+		const __m128i pixels = _mm_or_si128(_mm_or_si128(_mm_and_si128(corpse_mask, blue), _mm_and_si128(dead_mask, green)), red);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + p), pixels);
+	}
+#endif
+
+	for (; p < count; ++p)
+	{
+		out[p] = PackBGRA((dead[p] && energy[p] > 0) * 255, dead[p] * 255, (std::min(std::max(energy[p], 0.f), 100.f) / 100.f) * 255);
+	}
+}
+
+void FillFeedPixels(const LenseSource & source, int32 first, int32 count, uint32 * out)
+{
+	static const std::array<uint32, 256> palette = []()
+	{
+		// silver, green, blue, purple, red and yellow by FeedType
+		std::array<uint32, 256> packed = {};
+		packed[0] = PackBGRA(199, 195, 189);
+		packed[1] = PackBGRA(0, 255, 0);
+		packed[2] = PackBGRA(255, 0, 0);
+		packed[3] = PackBGRA(228, 7, 169);
+		packed[4] = PackBGRA(0, 0, 255);
+		packed[5] = PackBGRA(0, 255, 255);
+		return packed;
+	}();
+
+	const uint8 * feed = source.FeedType + first;
+	for (int32 p = 0; p < count; ++p)
+	{
+		out[p] = palette[feed[p]];
+	}
+}
+
+void FillGenomePixels(const LenseSource & source, int32 first, int32 count, uint32 * out)
+{
+	// the color only depends on the low byte of the fingerprint, so the hash is tabulated once
+	static const std::array<uint32, 256> palette = []()
+	{
+		std::hash<uint8> hasher;
+
+		std::array<uint32, 256> packed = {};
+		for (uint32 i = 0; i < packed.size(); ++i)
+		{
+			const size_t cache = hasher(static_cast<uint8>(i));
+			packed[i] = PackBGRA(cache % 255, (cache / 255) % 255, (cache / 255 / 255) % 255);
+		}
+		return packed;
+	}();
+
+	const uint64 * fingerprint = source.Fingerprint + first;
+	const bool * dead = source.Dead + first;
+	for (int32 p = 0; p < count; ++p)
+	{
+		// dead cells are black
+		out[p] = palette[static_cast<uint8>(fingerprint[p])] & (uint32(dead[p]) - 1);
+	}
+}
+
+void FillAgePixels(const LenseSource & source, int32 first, int32 count, uint32 * out)
+{
+	for (int32 p = 0; p < count; ++p)
+	{
+		const int32 depth = first + p;
+		const uint8 light = source.Light[depth] * 127;
+		out[p] = PackBGRA(source.Chemo[depth] * 127, light, light);
+	}
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+
+#include <vector>
+
+class CellSimulation;
+class WorldView;
+
+// What the lenses read, straight from a simulation or from a WorldView copy of it.
+// The columns are indexed like the world, light and chemo by depth.
+struct LenseSource
+{
+	Vec2i Size = {};
+	const float * Energy = nullptr;
+	const bool * Dead = nullptr;
+	const uint8 * FeedType = nullptr;
+	const uint64 * Fingerprint = nullptr;
+	const uint32 * RowStamp = nullptr;
+	uint32 Stamp = 0;
+	const float * Light = nullptr;
+	const float * Chemo = nullptr;
+};
+
+// the environment of the simulation's current time is put into light and chemo
+LenseSource GetLenseSource(const CellSimulation & simulation, std::vector<float> & light, std::vector<float> & chemo);
+LenseSource GetLenseSource(const WorldView & view);
+
+// Pixel painters of the lens views. Each one writes count BGRA pixels of the grid
+// slots [first, first + count) to out, so callers can split the grid as they like.
+
+constexpr uint32 PackBGRA(uint8 b, uint8 g, uint8 r)
+{
+	// alpha stays 0 like the zeroed buffers the textures were first filled from
+	return uint32(b) | (uint32(g) << 8) | (uint32(r) << 16);
+}
+
+void FillEnergyPixels(const LenseSource & source, int32 first, int32 count, uint32 * out);
+void FillFeedPixels(const LenseSource & source, int32 first, int32 count, uint32 * out);
+void FillGenomePixels(const LenseSource & source, int32 first, int32 count, uint32 * out);
+
+// the age lens is a strip of the environment, first and count are depths here
+void FillAgePixels(const LenseSource & source, int32 first, int32 count, uint32 * out);
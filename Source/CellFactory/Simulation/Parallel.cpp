@@ -0,0 +1,177 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Workers and the calling thread claim indices one at a time. Bodies are coarse
+	// (a tile, a block of rows), so claiming under the mutex costs nothing noticeable
+	// and keeps a late worker from ever seeing a half-published job.
+	class ThreadPool
+	{
+
+	public:
+
+		explicit ThreadPool(int32 workers)
+		{
+			for (int32 i = 0; i < workers; ++i)
+			{
+				Workers.emplace_back([this]() { WorkerLoop(); });
+			}
+		}
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				Stopping = true;
+			}
+			Wake.notify_all();
+
+			for (auto & worker : Workers)
+			{
+				worker.join();
+			}
+		}
+
+		void Run(int32 count, const ParallelBody & body)
+		{
+			// nested calls from inside a body and pools without workers run inline
+			if (Workers.empty() || count == 1 || InsideRun)
+			{
+				for (int32 i = 0; i < count; ++i)
+				{
+					body(i);
+				}
+				return;
+			}
+
+			std::lock_guard<std::mutex> run_lock(RunMutex);
+
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				Body = &body;
+				Count = count;
+				Next = 0;
+				Done = 0;
+				++Generation;
+			}
+			Wake.notify_all();
+
+			Work();
+
+			std::unique_lock<std::mutex> lock(Mutex);
+			Finished.wait(lock, [this]() { return Done == Count; });
+			Body = nullptr;
+		}
+
+	private:
+
+		void WorkerLoop()
+		{
+			uint64 seen = 0;
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(Mutex);
+					Wake.wait(lock, [&]() { return Stopping || Generation != seen; });
+					if (Stopping)
+					{
+						return;
+					}
+					seen = Generation;
+				}
+
+				Work();
+			}
+		}
+
+		void Work()
+		{
+			InsideRun = true;
+
+			for (;;)
+			{
+				int32 index;
+				const ParallelBody * body;
+				{
+					std::lock_guard<std::mutex> lock(Mutex);
+					if (Next >= Count)
+					{
+						break;
+					}
+					index = Next++;
+					body = Body;
+				}
+
+				(*body)(index);
+
+				std::lock_guard<std::mutex> lock(Mutex);
+				if (++Done == Count)
+				{
+					Finished.notify_all();
+				}
+			}
+
+			InsideRun = false;
+		}
+
+		std::vector<std::thread> Workers;
+
+		std::mutex RunMutex;
+		std::mutex Mutex;
+		std::condition_variable Wake;
+		std::condition_variable Finished;
+
+		const ParallelBody * Body = nullptr;
+		int32 Count = 0;
+		int32 Next = 0;
+		int32 Done = 0;
+		uint64 Generation = 0;
+		bool Stopping = false;
+
+		static thread_local bool InsideRun;
+	};
+
+	thread_local bool ThreadPool::InsideRun = false;
+
+	ThreadPool & GetPool()
+	{
+		static ThreadPool pool(std::max(1, static_cast<int32>(std::thread::hardware_concurrency())) - 1);
+		return pool;
+	}
+
+	ParallelRunner & GetOverride()
+	{
+		static ParallelRunner function;
+		return function;
+	}
+}
+
+void RunParallel(int32 count, const ParallelBody & body)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	if (auto & function = GetOverride())
+	{
+		function(count, body);
+	}
+	else
+	{
+		GetPool().Run(count, body);
+	}
+}
+
+void SetParallelRunner(ParallelRunner function)
+{
+	GetOverride() = std::move(function);
+}
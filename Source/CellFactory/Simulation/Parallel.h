@@ -0,0 +1,18 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+
+#include <functional>
+
+using ParallelBody = std::function<void(int32)>;
+using ParallelRunner = std::function<void(int32 count, const ParallelBody & body)>;
+
+// Calls body for every index in [0, count) and returns once all calls are done. Calls may
+// run concurrently. By default they are spread over a pool of std::threads shared by the
+// whole process. A host with its own job system (the game) installs it with SetParallelRunner.
+void RunParallel(int32 count, const ParallelBody & body);
+
+// an empty function restores the built-in pool
+void SetParallelRunner(ParallelRunner function);
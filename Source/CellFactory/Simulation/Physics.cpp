@@ -0,0 +1,203 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "Physics.h"
+#include "CellWorld.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+static_assert(sizeof(Vec2f) == 2 * sizeof(float), "the integration reads Vec2f columns as plain floats");
+
+static bool WantsMove(const Vec2f & delta)
+{
+	return delta.X > 1 || delta.X < -1 || delta.Y < -1 || delta.Y > 1;
+}
+
+// scalar form of the integration, also what the vector one has to match bit for bit
+static void IntegrateSlot(CellWorld & world, int32 index, std::vector<int32> & intents)
+{
+	Vec2f & speed = world.Speed[index];
+	Vec2f & delta = world.accumulated_delta[index];
+	delta += speed;
+	speed *= 0.9f;
+
+	if (!world.Dead[index] && WantsMove(delta))
+	{
+		intents.push_back(index);
+	}
+}
+
+// slots [first, first + count) of one row, InActive standing for "not empty" as it does
+// right after a compaction
+static void IntegrateRun(CellWorld & world, int32 first, int32 count, std::vector<int32> & intents)
+{
+	float * speed = &world.Speed[first].X;
+	float * delta = &world.accumulated_delta[first].X;
+	const bool * active = &world.InActive[first];
+	const bool * dead = &world.Dead[first];
+
+	int32 p = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+	const __m128 damping = _mm_set1_ps(0.9f);
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 sign = _mm_set1_ps(-0.f);
+	const __m128i zero = _mm_setzero_si128();
+
+	// four slots per round, two per register as X, Y, X, Y
+	for (; p + 4 <= count; p += 4)
+	{
+		int32 active4;
+		int32 live4;
+		std::memcpy(&active4, active + p, 4);
+		std::memcpy(&live4, dead + p, 4);
+		if (active4 == 0)
+		{
+			continue;
+		}
+		// bytes are 0 or 1, live means active and not dead
+		live4 = active4 & ~live4;
+
+		// one byte per slot widened to a lane per slot, then to both floats of the slot
+		const __m128i active_bytes = _mm_cvtsi32_si128(active4);
+		const __m128i active_slots = _mm_cmpgt_epi32(_mm_unpacklo_epi16(_mm_unpacklo_epi8(active_bytes, zero), zero), zero);
+		const __m128 mask_low = _mm_castsi128_ps(_mm_unpacklo_epi32(active_slots, active_slots));
+		const __m128 mask_high = _mm_castsi128_ps(_mm_unpackhi_epi32(active_slots, active_slots));
+
+		__m128 speed_low = _mm_loadu_ps(speed + p * 2);
+		__m128 speed_high = _mm_loadu_ps(speed + p * 2 + 4);
+		__m128 delta_low = _mm_loadu_ps(delta + p * 2);
+		__m128 delta_high = _mm_loadu_ps(delta + p * 2 + 4);
+
+		// empty slots keep what they hold, adding zero and scaling by one leaves it as it was
+		delta_low = _mm_add_ps(delta_low, _mm_and_ps(speed_low, mask_low));
+		delta_high = _mm_add_ps(delta_high, _mm_and_ps(speed_high, mask_high));
+		speed_low = _mm_mul_ps(speed_low, _mm_or_ps(_mm_and_ps(mask_low, damping), _mm_andnot_ps(mask_low, one)));
+		speed_high = _mm_mul_ps(speed_high, _mm_or_ps(_mm_and_ps(mask_high, damping), _mm_andnot_ps(mask_high, one)));
+
+		_mm_storeu_ps(speed + p * 2, speed_low);
+		_mm_storeu_ps(speed + p * 2 + 4, speed_high);
+		_mm_storeu_ps(delta + p * 2, delta_low);
+		_mm_storeu_ps(delta + p * 2 + 4, delta_high);
+
+		// a bit per float past a whole slot, two bits per slot
+		const int32 beyond = _mm_movemask_ps(_mm_cmpgt_ps(_mm_andnot_ps(sign, delta_low), one))
+			| (_mm_movemask_ps(_mm_cmpgt_ps(_mm_andnot_ps(sign, delta_high), one)) << 4);
+		if (beyond == 0 || live4 == 0)
+		{
+			continue;
+		}
+		for (int32 k = 0; k < 4; ++k)
+		{
+			if (((beyond >> (k * 2)) & 3) && ((live4 >> (k * 8)) & 1))
+			{
+				intents.push_back(first + p + k);
+			}
+		}
+	}
+#endif
+
+	for (; p < count; ++p)
+	{
+		if (active[p])
+		{
+			IntegrateSlot(world, first + p, intents);
+		}
+	}
+}
+
+void IntegrateChunk(CellWorld & world, int32 chunk, std::vector<int32> & intents)
+{
+	const auto & active = world.ChunkList[chunk].Active;
+	const int32 edge = world.ChunkSize;
+
+	const int32 first_x = (chunk / world.Chunks.Y) * edge;
+	const int32 first_y = (chunk % world.Chunks.Y) * edge;
+	const int32 end_x = std::min(first_x + edge, world.Size.X);
+	const int32 length = std::min(first_y + edge, world.Size.Y) - first_y;
+
+	// A sparse chunk is cheaper to walk by its list. A dense one is swept row by row over
+	// the contiguous columns, the order of the intents then differs from the list's, which
+	// only matters if the list is not sorted.
+	if (static_cast<int32>(active.size()) * 4 < (end_x - first_x) * length)
+	{
+		for (auto index : active)
+		{
+			IntegrateSlot(world, index, intents);
+		}
+		return;
+	}
+
+	for (int32 x = first_x; x < end_x; ++x)
+	{
+		IntegrateRun(world, x * world.Size.Y + first_y, length, intents);
+	}
+}
+
+template <typename Layout>
+void ResolveMoves(CellWorld & world, const std::vector<int32> & intents, std::vector<int32> & activated, const Layout & layout)
+{
+	for (auto index : intents)
+	{
+		// the interpreter may have killed the cell since
+		if (world.Dead[index])
+		{
+			continue;
+		}
+
+		const Vec2i pos = layout.ToCell(index);
+		Vec2f & delta = world.accumulated_delta[index];
+
+		// one axis and direction per step, in the order the checks always had, as a gRotations entry
+		uint32 step = 0;
+		Vec2f back = { 0, 0 };
+		if (delta.X > 1)
+		{
+			step = 2;
+			back = { -1, 0 };
+		}
+		else if (delta.X < -1)
+		{
+			step = 6;
+			back = { 1, 0 };
+		}
+		else if (delta.Y < -1)
+		{
+			step = 4;
+			back = { 0, 1 };
+		}
+		else if (delta.Y > 1)
+		{
+			step = 0;
+			back = { 0, -1 };
+		}
+		else
+		{
+			// the slot is not the one that wanted to move, its cell starved and another was
+			// born there or an earlier intent moved in
+			continue;
+		}
+
+		const int32 n_index = world.GetNeighbor(index, pos, step);
+		if (world.IsEmpty(n_index))
+		{
+			// the cell takes everything it counts for along, the statistics stay as they are
+			delta += back;
+			world.Swap(index, n_index);
+			world.Activate(n_index, activated);
+		}
+		else
+		{
+			delta = {};
+			world.Speed[index] /= 2.f;
+		}
+	}
+}
+
+// the layouts CellSimulation::Step ticks with
+template void ResolveMoves(CellWorld & world, const std::vector<int32> & intents, std::vector<int32> & activated, const DepthDivide & layout);
+template void ResolveMoves(CellWorld & world, const std::vector<int32> & intents, std::vector<int32> & activated, const DepthShift & layout);
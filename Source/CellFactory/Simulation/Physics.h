@@ -0,0 +1,24 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+
+#include <vector>
+
+class CellWorld;
+
+// Movement in two passes around the genome interpreter. IntegrateChunk runs first over
+// every awake chunk: active cells add Speed to accumulated_delta and lose a tenth of it.
+// Live cells whose delta crossed a whole slot come out as move intents, which ResolveMoves
+// carries out after the interpreter, against the occupancy the interpreter left behind.
+
+// intents of chunk are appended to intents
+void IntegrateChunk(CellWorld & world, int32 chunk, std::vector<int32> & intents);
+
+// Moves every still live cell of intents one slot along its accumulated_delta (X before Y)
+// if that slot is empty, halves its speed otherwise. Slots moved to are activated into
+// activated. All slots touched lie next to the intents, so chunks of one color can resolve
+// concurrently. Layout (DepthDivide or DepthShift) splits the indices like the tick does.
+template <typename Layout>
+void ResolveMoves(CellWorld & world, const std::vector<int32> & intents, std::vector<int32> & activated, const Layout & layout);
@@ -0,0 +1,41 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "PopulationStats.h"
+
+void PopulationStats::Merge(const PopulationStats & other)
+{
+	Live += other.Live;
+	Decaying += other.Decaying;
+	Species += other.Species;
+	LiveEnergy += other.LiveEnergy;
+	DecayingEnergy += other.DecayingEnergy;
+
+	for (int32 k = 0; k < FeedTypes; ++k)
+	{
+		Feed[k] += other.Feed[k];
+	}
+	for (int32 k = 0; k < AgeBuckets; ++k)
+	{
+		Ages[k] += other.Ages[k];
+	}
+	for (int32 k = 0; k < EGene_MAX; ++k)
+	{
+		Genes[k] += other.Genes[k];
+	}
+}
+
+PopulationStats CountPopulation(const CellWorld & world)
+{
+	PopulationStats stats;
+
+	const SlotSample empty;
+	for (auto chunk : world.AwakeChunks)
+	{
+		for (auto index : world.ChunkList[chunk].Active)
+		{
+			stats.Change(empty, SampleSlot(world, index));
+		}
+	}
+
+	return stats;
+}
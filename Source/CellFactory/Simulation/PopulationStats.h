@@ -0,0 +1,143 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+#include "CellWorld.h"
+
+#include <algorithm>
+
+// What one slot adds to the population statistics. Empty slots add nothing.
+struct SlotSample
+{
+	// of a live cell
+	const GenomeProgram * Program = nullptr;
+	float Energy = 0;
+	uint16 Age = 0;
+	uint8 FeedType = 0;
+	bool Live = false;
+	bool Decaying = false;
+};
+
+inline SlotSample SampleSlot(const CellWorld & world, int32 index)
+{
+	SlotSample sample;
+	if (world.IsEmpty(index))
+	{
+		return sample;
+	}
+
+	sample.Live = !world.Dead[index];
+	sample.Decaying = !sample.Live;
+	sample.Program = sample.Live ? world.Program[index] : nullptr;
+	sample.Energy = world.Energy[index];
+	sample.Age = world.Age[index];
+	sample.FeedType = world.FeedType[index];
+	return sample;
+}
+
+// Aggregates over the whole world, kept up to date by whatever changes a slot: it samples
+// the slot before and after and hands both to Change. Reading them never scans the world.
+struct PopulationStats
+{
+	static constexpr int32 FeedTypes = 6;
+	static constexpr int32 AgeBuckets = 9;
+
+	// live cells and dead ones still decaying
+	int32 Live = 0;
+	int32 Decaying = 0;
+
+	double LiveEnergy = 0;
+	double DecayingEnergy = 0;
+
+	// live cells by FeedType: none yet, photo, chemo, from friends, from others, from corpses
+	std::array<int32, FeedTypes> Feed = {};
+
+	// live cells by age, bucket b holds ages [4^b - 1, 4^(b + 1) - 1)
+	std::array<int32, AgeBuckets> Ages = {};
+
+	// genes in the genomes of live cells, by EGene
+	std::array<int64, EGene_MAX> Genes = {};
+
+	// distinct genomes among live cells, GenomeCache::GetTopSpecies lists them
+	int32 Species = 0;
+
+	static int32 GetAgeBucket(uint16 age)
+	{
+		const uint32 value = uint32(age) + 1;
+		return (value >= 4) + (value >= 16) + (value >= 64) + (value >= 256)
+			+ (value >= 1024) + (value >= 4096) + (value >= 16384) + (value >= 65536);
+	}
+
+	void Change(const SlotSample & before, const SlotSample & after)
+	{
+		// most updates leave a live cell alive with its genome, only a few fields can move
+		if (before.Live && after.Live && before.Program == after.Program)
+		{
+			LiveEnergy += double(after.Energy) - double(before.Energy);
+			// unconditional, feed types flip too often for a branch to guess them
+			--Feed[std::min<int32>(before.FeedType, FeedTypes - 1)];
+			++Feed[std::min<int32>(after.FeedType, FeedTypes - 1)];
+
+			// ages grow by one most of the time, the bucket can only change with the top bit
+			const uint32 before_age = uint32(before.Age) + 1;
+			const uint32 after_age = uint32(after.Age) + 1;
+			if ((before_age ^ after_age) > std::min(before_age, after_age))
+			{
+				--Ages[GetAgeBucket(before.Age)];
+				++Ages[GetAgeBucket(after.Age)];
+			}
+			return;
+		}
+
+		// the genome and species counts only move on births, deaths and mutations
+		if (before.Program != after.Program)
+		{
+			AddGenes(before.Program, -1);
+			AddGenes(after.Program, 1);
+		}
+
+		Add(before, -1);
+		Add(after, 1);
+	}
+
+	// folds in the changes another instance collected, starting from zero
+	void Merge(const PopulationStats & other);
+
+private:
+
+	void Add(const SlotSample & sample, int32 sign)
+	{
+		if (sample.Live)
+		{
+			Live += sign;
+			LiveEnergy += sign * double(sample.Energy);
+			Feed[std::min<int32>(sample.FeedType, FeedTypes - 1)] += sign;
+			Ages[GetAgeBucket(sample.Age)] += sign;
+		}
+		else if (sample.Decaying)
+		{
+			Decaying += sign;
+			DecayingEnergy += sign * double(sample.Energy);
+		}
+	}
+
+	void AddGenes(const GenomeProgram * program, int32 sign)
+	{
+		if (program)
+		{
+			// whoever moves a species to or from zero counts it, workers may share one
+			const int32 population = program->Population.fetch_add(sign, std::memory_order_relaxed);
+			Species += (population == 0) - (population + sign == 0);
+
+			for (int32 gene = 0; gene < EGene_MAX; ++gene)
+			{
+				Genes[gene] += sign * program->GeneCounts[gene];
+			}
+		}
+	}
+};
+
+// the statistics of world counted from scratch, for worlds that did not come from steps
+// and whose programs have not been counted yet, as right after loading
+PopulationStats CountPopulation(const CellWorld & world);
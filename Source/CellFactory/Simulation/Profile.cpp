@@ -0,0 +1,54 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "Profile.h"
+
+#include <algorithm>
+#include <limits>
+
+void TickProfile::Merge(const TickProfile & other)
+{
+	for (int32 k = 0; k < Phases; ++k)
+	{
+		PhaseSeconds[k] += other.PhaseSeconds[k];
+	}
+	for (int32 k = 0; k < EGene_MAX; ++k)
+	{
+		GeneRuns[k] += other.GeneRuns[k];
+		GeneCycles[k] += other.GeneCycles[k];
+		GeneTimed[k] += other.GeneTimed[k];
+	}
+	Mutations += other.Mutations;
+}
+
+double TickProfile::GetClockCycles()
+{
+	static const double cycles = []()
+	{
+		// the fastest of a few tries, the others were interrupted
+		uint64 fastest = std::numeric_limits<uint64>::max();
+		for (int32 k = 0; k < 256; ++k)
+		{
+			const uint64 start = ReadCycles();
+			fastest = std::min(fastest, ReadCycles() - start);
+		}
+		return double(fastest);
+	}();
+	return cycles;
+}
+
+const char * TickProfile::GetPhaseName(EPhase phase)
+{
+	static const char * const names[] = { "Integrate", "Interpret", "Resolve", "Compact", "Repopulate", "Checksum" };
+	static_assert(sizeof(names) / sizeof(names[0]) == Phases, "a name for every phase");
+
+	return static_cast<int32>(phase) < Phases ? names[static_cast<int32>(phase)] : "";
+}
+
+const char * TickProfile::GetGeneName(int32 gene)
+{
+	static const char * const names[] = { "Trash", "MoveForward", "MoveBackward", "RotateCCW", "RotateCW", "Photo", "Chemo", "Death", "EatForward",
+		"Mitose", "GiveEnergy", "TakeEnergy", "Olding", "Regen", "Counter", "DetectFriend", "DetectEnergy" };
+	static_assert(sizeof(names) / sizeof(names[0]) == EGene_MAX, "a name for every gene");
+
+	return gene >= 0 && gene < EGene_MAX ? names[gene] : "";
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+
+#include <array>
+#include <chrono>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Hot path instrumentation of the simulation: time per phase of a step, genes run and their
+// estimated cycles. Game builds other than shipping have it; the CMake build only when
+// configured with -DCELL_PROFILE=ON, its option is off by default. Without it the counters
+// stay at zero and the scopes are not there at all.
+#ifndef CELL_PROFILE
+#if defined(UE_BUILD_SHIPPING) && UE_BUILD_SHIPPING
+#define CELL_PROFILE 0
+#else
+#define CELL_PROFILE 1
+#endif
+#endif
+
+enum class EPhase : uint8
+{
+	// speeds turned into moves, IntegrateChunk
+	Integrate,
+	// the genomes, UpdateCell
+	Interpret,
+	// moves swapped into place, ResolveMoves
+	Resolve,
+	// active lists compacted and sorted, dead genomes collected
+	Compact,
+	Repopulate,
+	Checksum,
+	Count,
+};
+
+// phases and genes of all steps since the last Clear, the simulation clears it per Run
+struct TickProfile
+{
+	static constexpr int32 Phases = static_cast<int32>(EPhase::Count);
+
+	// one gene in this many is timed, the cycles of the others are extrapolated
+	static constexpr uint64 GeneSampling = 64;
+
+	// seconds by EPhase, phases that run on worker threads add up their threads
+	std::array<double, Phases> PhaseSeconds = {};
+
+	// genes run by EGene
+	std::array<uint64, EGene_MAX> GeneRuns = {};
+
+	// cycles of the timed runs by EGene, and how many there were
+	std::array<uint64, EGene_MAX> GeneCycles = {};
+	std::array<uint64, EGene_MAX> GeneTimed = {};
+
+	// genome mutations, most of them run inside Interpret
+	uint64 Mutations = 0;
+
+	void Clear()
+	{
+		*this = TickProfile();
+	}
+
+	// folds in a profile collected on another thread
+	void Merge(const TickProfile & other);
+
+	// cycles all runs of the gene are estimated to have taken, without those of the clock
+	double GetGeneCycles(int32 gene) const
+	{
+		if (GeneTimed[gene] == 0)
+		{
+			return 0;
+		}
+		const double per_run = double(GeneCycles[gene]) / GeneTimed[gene] - GetClockCycles();
+		return per_run > 0 ? per_run * GeneRuns[gene] : 0;
+	}
+
+	static const char * GetPhaseName(EPhase phase);
+	static const char * GetGeneName(int32 gene);
+
+	// what reading the clock twice costs, measured once
+	static double GetClockCycles();
+
+	// the time stamp counter where there is one, nanoseconds elsewhere
+	static uint64 ReadCycles()
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+};
+
+// adds the time until the end of the scope to a phase
+class PhaseScope
+{
+
+public:
+
+	PhaseScope(TickProfile & profile, EPhase phase)
+		: Seconds(profile.PhaseSeconds[static_cast<int32>(phase)])
+		, Start(std::chrono::steady_clock::now())
+	{}
+
+	~PhaseScope()
+	{
+		Seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	}
+
+	PhaseScope(const PhaseScope &) = delete;
+	PhaseScope & operator=(const PhaseScope &) = delete;
+
+private:
+
+	double & Seconds;
+	std::chrono::steady_clock::time_point Start;
+};
+
+#if CELL_PROFILE
+#define CELL_PROFILE_JOIN_INNER(a, b) a##b
+#define CELL_PROFILE_JOIN(a, b) CELL_PROFILE_JOIN_INNER(a, b)
+#define CELL_PHASE_SCOPE(profile, phase) const PhaseScope CELL_PROFILE_JOIN(phase_scope_, __LINE__)(profile, phase)
+#define CELL_PROFILE_ONLY(...) __VA_ARGS__
+#else
+#define CELL_PHASE_SCOPE(profile, phase)
+#define CELL_PROFILE_ONLY(...)
+#endif
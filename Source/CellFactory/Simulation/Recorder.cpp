@@ -0,0 +1,608 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "Recorder.h"
+#include "Lenses.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// Recording file, little endian like the snapshots:
+//
+//   header   gRecordingMagic, version, world size, lenses (ERecordLense bits), tile edge
+//   frames   step, keyframe flag, then for every recorded lens in bit order the count of
+//            tiles stored, their bytes and the tiles: index (column of tiles major, like
+//            the cells), run count and runs of (length, BGRA pixel) over the tile's
+//            pixels row by row. Tiles left out are as in the frame before, a keyframe
+//            stores all of them.
+//   index    frame count x (frame offset, step, keyframe flag)
+//   trailer  index offset, frame count, gIndexMagic
+//
+// A recording that was never closed has no trailer and cannot be read back.
+
+namespace
+{
+	constexpr char gRecordingMagic[8] = { 'C', 'E', 'L', 'L', 'R', 'E', 'C', 'D' };
+	constexpr char gIndexMagic[8] = { 'C', 'E', 'L', 'L', 'I', 'N', 'D', 'X' };
+	constexpr uint32 gRecordingVersion = 1;
+
+	// edge of the tiles a frame is compared and stored by, in cells
+	constexpr int32 gTileSize = 16;
+
+	constexpr size_t gHeaderSize = 8 + 4 + 2 * 4 + 4 + 4;
+	constexpr size_t gEntrySize = 8 + 8 + 4;
+	constexpr size_t gTrailerSize = 8 + 4 + 8;
+
+	template <typename T>
+	void Put(std::vector<uint8> & buffer, const T & value)
+	{
+		const size_t at = buffer.size();
+		buffer.resize(at + sizeof(T));
+		std::memcpy(buffer.data() + at, &value, sizeof(T));
+	}
+
+	template <typename T>
+	T Get(const uint8 * & at)
+	{
+		T value;
+		std::memcpy(&value, at, sizeof(T));
+		at += sizeof(T);
+		return value;
+	}
+
+	void PutHeader(std::vector<uint8> & buffer, const Vec2i & size, uint32 lenses)
+	{
+		Put(buffer, gRecordingMagic);
+		Put(buffer, gRecordingVersion);
+		Put(buffer, size.X);
+		Put(buffer, size.Y);
+		Put(buffer, lenses);
+		Put(buffer, static_cast<uint32>(gTileSize));
+	}
+
+	bool Seek(std::FILE * file, int64 offset, int origin = SEEK_SET)
+	{
+#if defined(_WIN32)
+		return _fseeki64(file, offset, origin) == 0;
+#else
+		return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+	}
+
+	bool ReadBytes(std::FILE * file, void * data, size_t size)
+	{
+		return std::fread(data, 1, size, file) == size;
+	}
+
+	int32 CountLenses(uint32 lenses)
+	{
+		int32 count = 0;
+		for (; lenses != 0; lenses &= lenses - 1)
+		{
+			++count;
+		}
+		return count;
+	}
+
+	// walks the cells of a tile of the world row by row
+	template <typename Function>
+	void ForTile(const Vec2i & size, int32 tile, Function function)
+	{
+		const int32 tiles_y = (size.Y + gTileSize - 1) / gTileSize;
+		const int32 first_x = (tile / tiles_y) * gTileSize;
+		const int32 first_y = (tile % tiles_y) * gTileSize;
+		const int32 end_x = std::min(first_x + gTileSize, size.X);
+		const int32 end_y = std::min(first_y + gTileSize, size.Y);
+		for (int32 x = first_x; x < end_x; ++x)
+		{
+			function(x * size.Y + first_y, end_y - first_y);
+		}
+	}
+}
+
+SimulationRecorder::~SimulationRecorder()
+{
+	Close();
+}
+
+bool SimulationRecorder::Open(const std::string & path, uint32 lenses, int32 interval, int32 keyframe_interval)
+{
+	Close();
+
+	File = std::fopen(path.c_str(), "wb");
+	if (!File)
+	{
+		return false;
+	}
+
+	Lenses = lenses & RecordAllLenses;
+	Interval = std::max(interval, 1);
+	KeyframeInterval = std::max(keyframe_interval, 1);
+	Calls = 0;
+	Size = {};
+
+	Stopping = false;
+	Frames = 0;
+	Dropped = 0;
+	States = { { EViewState::Free, EViewState::Free } };
+	Oldest = -1;
+
+	Painted = false;
+	Current.assign(CountLenses(Lenses), std::vector<uint32>());
+	Previous.assign(CountLenses(Lenses), std::vector<uint32>());
+	Index.clear();
+	Written = 0;
+
+	Writer = std::thread([this]() { Loop(); });
+	return true;
+}
+
+void SimulationRecorder::Close()
+{
+	if (!File)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Stopping = true;
+	}
+	Wake.notify_one();
+	Writer.join();
+
+	// a recording without frames still gets its header
+	Buffer.clear();
+	if (Written == 0)
+	{
+		PutHeader(Buffer, Size, Lenses);
+		Written = Buffer.size();
+	}
+
+	const uint64 index_offset = Written;
+	for (const auto & entry : Index)
+	{
+		Put(Buffer, entry.Offset);
+		Put(Buffer, entry.Step);
+		Put(Buffer, entry.Keyframe);
+	}
+	Put(Buffer, index_offset);
+	Put(Buffer, static_cast<uint32>(Index.size()));
+	Put(Buffer, gIndexMagic);
+
+	std::fwrite(Buffer.data(), 1, Buffer.size(), File);
+	std::fclose(File);
+	File = nullptr;
+}
+
+int32 SimulationRecorder::GetFrames() const
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	return Frames;
+}
+
+int32 SimulationRecorder::GetDropped() const
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	return Dropped;
+}
+
+void SimulationRecorder::Capture(const CellSimulation & simulation)
+{
+	if (!File || ++Calls % Interval != 0)
+	{
+		return;
+	}
+
+	int32 slot = -1;
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		if (Size == Vec2i())
+		{
+			Size = simulation.mArray.Size;
+		}
+		for (int32 k = 0; k < static_cast<int32>(States.size()) && Size == simulation.mArray.Size; ++k)
+		{
+			if (States[k] == EViewState::Free)
+			{
+				slot = k;
+				break;
+			}
+		}
+		if (slot < 0)
+		{
+			++Dropped;
+			return;
+		}
+	}
+
+	// the writer leaves free views alone, so the copy runs without the lock; it only takes
+	// the rows changed since this view's previous capture
+	Views[slot].Update(simulation);
+
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		States[slot] = EViewState::Queued;
+		Steps[slot] = simulation.GetStepCount();
+		if (Oldest < 0)
+		{
+			Oldest = slot;
+		}
+	}
+	Wake.notify_one();
+}
+
+void SimulationRecorder::Loop()
+{
+	for (;;)
+	{
+		int32 slot;
+		uint64 step;
+		{
+			std::unique_lock<std::mutex> lock(Mutex);
+			Wake.wait(lock, [this]() { return Stopping || Oldest >= 0; });
+			// whatever was handed over before Close is still written
+			if (Oldest < 0)
+			{
+				return;
+			}
+
+			slot = Oldest;
+			step = Steps[slot];
+			States[slot] = EViewState::Painting;
+			const int32 other = 1 - slot;
+			Oldest = States[other] == EViewState::Queued ? other : -1;
+		}
+
+		Paint(Views[slot]);
+
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			States[slot] = EViewState::Free;
+		}
+
+		Encode(step, Index.size() % KeyframeInterval == 0);
+
+		std::lock_guard<std::mutex> lock(Mutex);
+		++Frames;
+	}
+}
+
+void SimulationRecorder::Paint(const WorldView & view)
+{
+	const LenseSource source = GetLenseSource(view);
+	const int32 row_length = source.Size.Y;
+	const bool full = !Painted || PaintedGeneration != view.Generation;
+
+	int32 slot = 0;
+	for (uint32 mask = Lenses; mask != 0; mask &= mask - 1, ++slot)
+	{
+		const uint32 lense = mask & (~mask + 1);
+		auto & pixels = Current[slot];
+		pixels.resize(source.Size.Capacity());
+
+		// rows stamped after the previous frame are the only ones that can look different
+		for (int32 row = 0; row < source.Size.X; ++row)
+		{
+			if (!full && source.RowStamp[row] <= PaintedStamp)
+			{
+				continue;
+			}
+
+			const int32 first = row * row_length;
+			switch (lense)
+			{
+			case RecordEnergy:
+				FillEnergyPixels(source, first, row_length, pixels.data() + first);
+				break;
+			case RecordGenome:
+				FillGenomePixels(source, first, row_length, pixels.data() + first);
+				break;
+			case RecordFeed:
+				FillFeedPixels(source, first, row_length, pixels.data() + first);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	Painted = true;
+	PaintedStamp = view.Stamp;
+	PaintedGeneration = view.Generation;
+}
+
+void SimulationRecorder::Encode(uint64 step, bool keyframe)
+{
+	const int32 tiles_x = (Size.X + gTileSize - 1) / gTileSize;
+	const int32 tiles_y = (Size.Y + gTileSize - 1) / gTileSize;
+
+	Buffer.clear();
+	if (Written == 0)
+	{
+		PutHeader(Buffer, Size, Lenses);
+	}
+
+	// a lens seen for the first time or at another size has nothing to be compared with
+	for (size_t slot = 0; slot < Current.size(); ++slot)
+	{
+		if (Previous[slot].size() != Current[slot].size())
+		{
+			Previous[slot].assign(Current[slot].size(), 0);
+			keyframe = true;
+		}
+	}
+
+	const uint64 offset = Written + Buffer.size();
+	Put(Buffer, step);
+	Put(Buffer, static_cast<uint32>(keyframe));
+
+	for (size_t slot = 0; slot < Current.size(); ++slot)
+	{
+		const auto & current = Current[slot];
+		auto & previous = Previous[slot];
+
+		// the count and the size of the lens are filled in once its tiles are written
+		const size_t header_at = Buffer.size();
+		Put(Buffer, uint32(0));
+		Put(Buffer, uint32(0));
+		uint32 stored = 0;
+
+		for (int32 tile = 0; tile < tiles_x * tiles_y; ++tile)
+		{
+			bool changed = keyframe;
+			ForTile(Size, tile, [&](int32 first, int32 count)
+			{
+				changed = changed || std::memcmp(current.data() + first, previous.data() + first, count * sizeof(uint32)) != 0;
+			});
+			if (!changed)
+			{
+				continue;
+			}
+
+			Put(Buffer, static_cast<uint32>(tile));
+			const size_t runs_at = Buffer.size();
+			Put(Buffer, uint16(0));
+
+			// runs go on across the rows of the tile, a tile of one color is a single run
+			uint16 runs = 0;
+			uint16 length = 0;
+			uint32 color = 0;
+			ForTile(Size, tile, [&](int32 first, int32 count)
+			{
+				for (int32 k = 0; k < count; ++k)
+				{
+					const uint32 pixel = current[first + k];
+					if (length > 0 && pixel == color)
+					{
+						++length;
+						continue;
+					}
+					if (length > 0)
+					{
+						Put(Buffer, length);
+						Put(Buffer, color);
+						++runs;
+					}
+					color = pixel;
+					length = 1;
+				}
+				std::memcpy(previous.data() + first, current.data() + first, count * sizeof(uint32));
+			});
+			Put(Buffer, length);
+			Put(Buffer, color);
+			++runs;
+
+			std::memcpy(Buffer.data() + runs_at, &runs, sizeof(runs));
+			++stored;
+		}
+
+		const uint32 bytes = static_cast<uint32>(Buffer.size() - header_at - 2 * sizeof(uint32));
+		std::memcpy(Buffer.data() + header_at, &stored, sizeof(stored));
+		std::memcpy(Buffer.data() + header_at + sizeof(stored), &bytes, sizeof(bytes));
+	}
+
+	std::fwrite(Buffer.data(), 1, Buffer.size(), File);
+	Written += Buffer.size();
+
+	IndexEntry entry;
+	entry.Offset = offset;
+	entry.Step = step;
+	entry.Keyframe = keyframe;
+	Index.push_back(entry);
+}
+
+RecordingReader::~RecordingReader()
+{
+	if (File)
+	{
+		std::fclose(File);
+	}
+}
+
+bool RecordingReader::Open(const std::string & path)
+{
+	if (File)
+	{
+		std::fclose(File);
+	}
+	Entries.clear();
+	DecodedFrame = -1;
+
+	File = std::fopen(path.c_str(), "rb");
+	if (!File)
+	{
+		return false;
+	}
+
+	uint8 header[gHeaderSize];
+	if (!ReadBytes(File, header, sizeof(header)) || std::memcmp(header, gRecordingMagic, sizeof(gRecordingMagic)) != 0)
+	{
+		return false;
+	}
+	const uint8 * at = header + sizeof(gRecordingMagic);
+	if (Get<uint32>(at) != gRecordingVersion)
+	{
+		return false;
+	}
+	Size.X = Get<int32>(at);
+	Size.Y = Get<int32>(at);
+	Lenses = Get<uint32>(at);
+	TileSize = static_cast<int32>(Get<uint32>(at));
+	if (Size.X < 0 || Size.Y < 0 || int64(Size.X) * Size.Y > std::numeric_limits<int32>::max() || TileSize != gTileSize)
+	{
+		return false;
+	}
+
+	uint8 trailer[gTrailerSize];
+	if (!Seek(File, -int64(gTrailerSize), SEEK_END) || !ReadBytes(File, trailer, sizeof(trailer))
+		|| std::memcmp(trailer + 12, gIndexMagic, sizeof(gIndexMagic)) != 0)
+	{
+		return false;
+	}
+	at = trailer;
+	const uint64 index_offset = Get<uint64>(at);
+	const uint32 count = Get<uint32>(at);
+
+	std::vector<uint8> index(size_t(count) * gEntrySize);
+	if (!Seek(File, static_cast<int64>(index_offset)) || !ReadBytes(File, index.data(), index.size()))
+	{
+		return false;
+	}
+
+	at = index.data();
+	Entries.resize(count);
+	for (auto & entry : Entries)
+	{
+		entry.Offset = Get<uint64>(at);
+		entry.Step = Get<uint64>(at);
+		entry.Keyframe = Get<uint32>(at) != 0;
+	}
+	return count == 0 || Entries[0].Keyframe;
+}
+
+bool RecordingReader::ReadFrame(int32 frame, uint32 lense, std::vector<uint32> & pixels)
+{
+	if (!File || frame < 0 || frame >= GetFrameCount() || CountLenses(lense) != 1 || !(Lenses & lense))
+	{
+		return false;
+	}
+	const int32 slot = CountLenses(Lenses & (lense - 1));
+
+	int32 keyframe = frame;
+	while (!Entries[keyframe].Keyframe)
+	{
+		--keyframe;
+	}
+
+	// going on from the frame decoded last is cheaper than the keyframe, unless it lies behind it
+	int32 start = keyframe;
+	if (DecodedLense == lense && DecodedFrame >= keyframe && DecodedFrame <= frame)
+	{
+		start = DecodedFrame + 1;
+	}
+	else
+	{
+		Decoded.assign(Size.Capacity(), 0);
+	}
+
+	for (int32 k = start; k <= frame; ++k)
+	{
+		if (!ApplyFrame(k, slot))
+		{
+			DecodedFrame = -1;
+			return false;
+		}
+		DecodedFrame = k;
+		DecodedLense = lense;
+	}
+
+	pixels = Decoded;
+	return true;
+}
+
+bool RecordingReader::ApplyFrame(int32 frame, int32 lense_slot)
+{
+	// step and keyframe flag are in the index already
+	if (!Seek(File, static_cast<int64>(Entries[frame].Offset) + 8 + 4))
+	{
+		return false;
+	}
+
+	uint32 stored = 0;
+	uint32 bytes = 0;
+	for (int32 slot = 0; slot <= lense_slot; ++slot)
+	{
+		uint8 header[2 * sizeof(uint32)];
+		if (!ReadBytes(File, header, sizeof(header)))
+		{
+			return false;
+		}
+		const uint8 * at = header;
+		stored = Get<uint32>(at);
+		bytes = Get<uint32>(at);
+		if (slot < lense_slot && !Seek(File, bytes, SEEK_CUR))
+		{
+			return false;
+		}
+	}
+
+	Buffer.resize(bytes);
+	if (!ReadBytes(File, Buffer.data(), bytes))
+	{
+		return false;
+	}
+
+	const int32 tiles = ((Size.X + TileSize - 1) / TileSize) * ((Size.Y + TileSize - 1) / TileSize);
+	const uint8 * at = Buffer.data();
+	const uint8 * end = at + bytes;
+	for (uint32 t = 0; t < stored; ++t)
+	{
+		if (end - at < 6)
+		{
+			return false;
+		}
+		const uint32 tile = Get<uint32>(at);
+		const uint16 runs = Get<uint16>(at);
+		if (tile >= uint32(tiles) || end - at < int64(runs) * 6)
+		{
+			return false;
+		}
+
+		// the runs are spread over the rows of the tile in order
+		uint16 run = 0;
+		uint16 left = 0;
+		uint32 color = 0;
+		bool valid = true;
+		ForTile(Size, static_cast<int32>(tile), [&](int32 first, int32 count)
+		{
+			for (int32 k = 0; k < count; ++k)
+			{
+				if (left == 0)
+				{
+					if (run == runs)
+					{
+						valid = false;
+						return;
+					}
+					left = Get<uint16>(at);
+					color = Get<uint32>(at);
+					++run;
+					if (left == 0)
+					{
+						valid = false;
+						return;
+					}
+				}
+				Decoded[first + k] = color;
+				--left;
+			}
+		});
+		if (!valid || run != runs || left != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,188 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+#include "WorldView.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CellSimulation;
+
+// lenses a recording holds, bits numbered like ACellActor's ELense; the age strip is not a grid
+enum ERecordLense : uint32
+{
+	RecordEnergy = 1 << 0,
+	RecordGenome = 1 << 2,
+	RecordFeed = 1 << 3,
+	RecordAllLenses = RecordEnergy | RecordGenome | RecordFeed,
+};
+
+// Records lens pictures of a running simulation into a file (format in Recorder.cpp).
+// Capture hands a copy of the rows changed since its previous capture to a writer
+// thread, which paints the lenses and stores every frame as the tiles that changed
+// since the frame before, run length encoded. An index at the end of the file lets
+// RecordingReader seek to any frame.
+class SimulationRecorder
+{
+
+public:
+
+	SimulationRecorder() = default;
+	SimulationRecorder(const SimulationRecorder &) = delete;
+	SimulationRecorder & operator = (const SimulationRecorder &) = delete;
+
+	~SimulationRecorder();
+
+	// Starts a recording of lenses (ERecordLense bits) that keeps every interval-th
+	// capture, false if the file cannot be created. A full frame is stored every
+	// keyframe_interval frames, seeking decodes from the one before.
+	bool Open(const std::string & path, uint32 lenses, int32 interval, int32 keyframe_interval = 32);
+
+	// Waits for the frames handed over so far and writes the index
+	void Close();
+
+	bool IsOpen() const
+	{
+		return File != nullptr;
+	}
+
+	// Called by the simulation after every tick, on its thread. Every interval-th call
+	// copies the changed rows into a view the writer is done with; when the writer is
+	// still busy with both the frame is dropped rather than holding up the simulation.
+	void Capture(const CellSimulation & simulation);
+
+	// frames written and frames dropped, including those of a world of another size than the first
+	int32 GetFrames() const;
+	int32 GetDropped() const;
+
+private:
+
+	void Loop();
+
+	// paints the lenses of the view into Current, only rows that changed since the last frame
+	void Paint(const WorldView & view);
+
+	// writes the tiles of Current that differ from Previous, all of them for a keyframe
+	void Encode(uint64 step, bool keyframe);
+
+	std::FILE * File = nullptr;
+	uint32 Lenses = 0;
+	int32 Interval = 1;
+	int32 KeyframeInterval = 32;
+	int32 Calls = 0;
+	Vec2i Size = {};
+
+	std::thread Writer;
+
+	// guards everything up to the views
+	mutable std::mutex Mutex;
+	std::condition_variable Wake;
+	bool Stopping = false;
+	int32 Frames = 0;
+	int32 Dropped = 0;
+
+	// a view is free, queued for the writer or being painted from
+	enum class EViewState : uint8
+	{
+		Free,
+		Queued,
+		Painting,
+	};
+	std::array<WorldView, 2> Views;
+	std::array<EViewState, 2> States = { { EViewState::Free, EViewState::Free } };
+	std::array<uint64, 2> Steps = {};
+	// the queued view that was captured first, -1 for none
+	int32 Oldest = -1;
+
+	// only used on the writer thread from here on
+	uint32 PaintedStamp = 0;
+	uint32 PaintedGeneration = 0;
+	bool Painted = false;
+
+	// by recorded lens, in bit order
+	std::vector<std::vector<uint32>> Current;
+	std::vector<std::vector<uint32>> Previous;
+	std::vector<uint8> Buffer;
+
+	struct IndexEntry
+	{
+		uint64 Offset;
+		uint64 Step;
+		uint32 Keyframe;
+	};
+	std::vector<IndexEntry> Index;
+	uint64 Written = 0;
+};
+
+// Reads back a recording of SimulationRecorder
+class RecordingReader
+{
+
+public:
+
+	RecordingReader() = default;
+	RecordingReader(const RecordingReader &) = delete;
+	RecordingReader & operator = (const RecordingReader &) = delete;
+
+	~RecordingReader();
+
+	// reads the header and the index, false if the file is missing, unfinished or of another version
+	bool Open(const std::string & path);
+
+	Vec2i GetSize() const
+	{
+		return Size;
+	}
+
+	uint32 GetLenses() const
+	{
+		return Lenses;
+	}
+
+	int32 GetFrameCount() const
+	{
+		return static_cast<int32>(Entries.size());
+	}
+
+	// the step of the simulation the frame was captured after
+	uint64 GetStep(int32 frame) const
+	{
+		return Entries[frame].Step;
+	}
+
+	// Pixels of the lense (one ERecordLense bit) as of frame, Size.Capacity() of them laid
+	// out like the lens textures. Reading frames in order decodes one frame each, seeking
+	// decodes from the keyframe before.
+	bool ReadFrame(int32 frame, uint32 lense, std::vector<uint32> & pixels);
+
+private:
+
+	// decodes the lens at lense_slot (in bit order) of frame onto Decoded
+	bool ApplyFrame(int32 frame, int32 lense_slot);
+
+	std::FILE * File = nullptr;
+	Vec2i Size = {};
+	uint32 Lenses = 0;
+	int32 TileSize = 0;
+
+	struct Entry
+	{
+		uint64 Offset;
+		uint64 Step;
+		bool Keyframe;
+	};
+	std::vector<Entry> Entries;
+
+	// the frame and lens Decoded holds
+	int32 DecodedFrame = -1;
+	uint32 DecodedLense = 0;
+	std::vector<uint32> Decoded;
+	std::vector<uint8> Buffer;
+};
@@ -0,0 +1,67 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "Replay.h"
+
+ReplayLog::~ReplayLog()
+{
+	if (File)
+	{
+		std::fclose(File);
+	}
+}
+
+bool ReplayLog::Open(const std::string & path)
+{
+	if (File)
+	{
+		std::fclose(File);
+	}
+
+	File = std::fopen(path.c_str(), "w");
+	return File != nullptr;
+}
+
+bool ReplayLog::LoadReference(const std::string & path)
+{
+	std::FILE * file = std::fopen(path.c_str(), "r");
+	if (!file)
+	{
+		return false;
+	}
+
+	Reference.clear();
+
+	unsigned long long step;
+	unsigned long long checksum;
+	while (std::fscanf(file, "%llu %llx", &step, &checksum) == 2)
+	{
+		Reference[step] = checksum;
+	}
+
+	std::fclose(file);
+	return true;
+}
+
+void ReplayLog::Record(uint64 step, uint64 checksum)
+{
+	if (File)
+	{
+		std::fprintf(File, "%llu %016llx\n", static_cast<unsigned long long>(step), static_cast<unsigned long long>(checksum));
+	}
+
+	// a rolling checksum that differed once differs ever after, only the first one is kept
+	auto found = Reference.find(step);
+	if (found == Reference.end() || DivergedStep != 0)
+	{
+		return;
+	}
+
+	if (found->second == checksum)
+	{
+		++Matched;
+	}
+	else
+	{
+		DivergedStep = step;
+	}
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+// Log of the rolling world checksums of a run, one "step checksum" text line each.
+// With the log of a reference run loaded it also tells the first step where this run
+// stopped matching it.
+class ReplayLog
+{
+
+public:
+
+	ReplayLog() = default;
+	ReplayLog(const ReplayLog &) = delete;
+	ReplayLog & operator = (const ReplayLog &) = delete;
+
+	~ReplayLog();
+
+	// starts writing the log to path, false if it cannot be created
+	bool Open(const std::string & path);
+
+	// reads a log written by an earlier run, false if it cannot be read
+	bool LoadReference(const std::string & path);
+
+	void Record(uint64 step, uint64 checksum);
+
+	// first recorded step whose checksum differs from the reference, 0 while none did
+	uint64 GetDivergedStep() const
+	{
+		return DivergedStep;
+	}
+
+	// recorded steps that were found in the reference with the same checksum
+	int32 GetMatched() const
+	{
+		return Matched;
+	}
+
+private:
+
+	std::FILE * File = nullptr;
+
+	std::unordered_map<uint64, uint64> Reference;
+	uint64 DivergedStep = 0;
+	int32 Matched = 0;
+};
@@ -0,0 +1,833 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "Simulation.h"
+#include "Parallel.h"
+#include "Physics.h"
+#include "Recorder.h"
+#include "Replay.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// 64-bit finalizer of the world checksums
+static uint64 MixChecksum(uint64 value)
+{
+	value ^= value >> 33;
+	value *= 0xFF51AFD7ED558CCDULL;
+	value ^= value >> 33;
+	value *= 0xC4CEB9FE1A85EC53ULL;
+	value ^= value >> 33;
+	return value;
+}
+
+static uint32 FloatBits(float value)
+{
+	uint32 bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+// streams of the draws outside of a step, the steps use the streams below
+static constexpr uint64 gOffStepStream = 1ULL << 63;
+
+// numbers per repopulation seed: speed, rotation, energy, genome and slot
+static constexpr int32 gSeedNumbers = 2 + 1 + 1 + gGenomeSize + 1;
+
+void CellSimulation::Mutate(CellRef cell, bool rehash)
+{
+	const SlotSample before = SampleSlot(mArray, cell.GetIndex());
+
+	CellRandom random(Random, gOffStepStream | RandomDraws++, 0);
+	Mutate(cell, rehash, random);
+	CELL_PROFILE_ONLY(++Profile.Mutations);
+
+	Stats.Change(before, SampleSlot(mArray, cell.GetIndex()));
+}
+
+void CellSimulation::Mutate(CellRef cell, bool rehash, CellRandom & random)
+{
+	const auto gene = random.RandHelper(std::numeric_limits<GeneType>::max());
+	cell.SetGene(random.RandHelper(gGenomeSize), gene);
+	if (rehash)
+	{
+		cell.Fingerprint = cell.Program->Fingerprint;
+	}
+	else
+	{
+		++cell.GeneDeviation;
+	}
+}
+
+float CellSimulation::GetTime() const
+{
+	return time_ticks / 1000.f;
+}
+
+float CellSimulation::GetLight(int32 depth) const
+{
+	return (std::abs((std::cos(GetTime()) + std::sin(GetTime() * 4) + 2) / 4.f) * Parameters.SunMax * (1 - (depth / float(mArray.Size.Y)))) + Parameters.SunMin;
+}
+
+float CellSimulation::GetChemo(int32 depth) const
+{
+	auto chemenergy = (depth / float(mArray.Size.Y)) * Parameters.MinMax + Parameters.MinMin;
+	return chemenergy;
+}
+
+void CellSimulation::Reset(int32 seed)
+{
+	Random.Initialize(seed);
+	RandomDraws = 0;
+	StepCount = 0;
+	StepSeconds = 0;
+	RollingChecksum = 0;
+
+	// at least one full rotation neighbourhood, and every index has to fit an int32
+	Vec2i size = Parameters.WorldSize;
+	size.X = std::max(size.X, 3);
+	size.Y = std::max(size.Y, 3);
+	size.Y = std::min(size.Y, std::numeric_limits<int32>::max() / size.X);
+	mArray.Topology = Parameters.Topology;
+	mArray.Resize(size, Parameters.HugePages);
+	mArray.SetChunkSize(GetTileSize());
+
+	Repopulate();
+	Repopulations = 0;
+}
+
+void CellSimulation::Run(int32 iterations)
+{
+	TickUpdated = 0;
+	CELL_PROFILE_ONLY(Profile.Clear());
+
+	for (int32 iter = 0; iter < iterations; ++iter)
+	{
+		Step();
+
+		TickUpdated += LastUpdated;
+	}
+
+	if (LastUpdated < 300)
+	{
+		Repopulate();
+	}
+
+	if (Recorder)
+	{
+		Recorder->Capture(*this);
+	}
+}
+
+int32 CellSimulation::RunBudgeted(double budget_seconds, int32 max_iterations)
+{
+	using Clock = std::chrono::steady_clock;
+
+	TickUpdated = 0;
+	CELL_PROFILE_ONLY(Profile.Clear());
+
+	const auto start = Clock::now();
+	auto last = start;
+
+	int32 iterations = 0;
+	while (iterations < std::max(max_iterations, 1))
+	{
+		Step();
+		++iterations;
+
+		TickUpdated += LastUpdated;
+
+		// a step costs about what the previous few did, the population changes slowly
+		const auto now = Clock::now();
+		const double seconds = std::chrono::duration<double>(now - last).count();
+		StepSeconds = StepSeconds > 0 ? StepSeconds + (seconds - StepSeconds) * 0.25 : seconds;
+		const double elapsed = std::chrono::duration<double>(now - start).count();
+		last = now;
+
+		if (elapsed + StepSeconds > budget_seconds)
+		{
+			break;
+		}
+	}
+
+	if (LastUpdated < 300)
+	{
+		Repopulate();
+	}
+
+	if (Recorder)
+	{
+		Recorder->Capture(*this);
+	}
+
+	return iterations;
+}
+
+void CellSimulation::Step()
+{
+	++time_ticks;
+
+	Photo.resize(mArray.Size.Y);
+	Chemo.resize(mArray.Size.Y);
+
+	for (int32 j = 0; j < mArray.Size.Y; ++j)
+	{
+		Photo[j] = GetLight(j);
+		Chemo[j] = GetChemo(j);
+	}
+
+	// chunks double as the parallel tiles, TileSize may have changed since the last step
+	const int32 tile = GetTileSize();
+	if (tile != mArray.ChunkSize)
+	{
+		mArray.SetChunkSize(tile);
+	}
+	if (Parameters.Topology != mArray.Topology)
+	{
+		mArray.SetTopology(Parameters.Topology);
+	}
+
+	auto updated = 0;
+
+	// the colored pass gives the same result whether its chunks run concurrently or not,
+	// as long as the colors also alternate around the edges that wrap
+	const bool concurrent = Parameters.ParallelTick && mArray.Size.X % (tile * 2) == 0
+		&& (Parameters.Topology != ETopology::Torus || mArray.Size.Y % (tile * 2) == 0);
+
+	// every active cell moves on by its speed before any genome runs, chunks touch only their own slots
+	ChunkIntents.resize(mArray.ChunkList.size());
+	const auto integrate_chunk = [this](int32 k)
+	{
+		const int32 chunk = mArray.AwakeChunks[k];
+		ChunkIntents[chunk].clear();
+		IntegrateChunk(mArray, chunk, ChunkIntents[chunk]);
+	};
+	if (concurrent)
+	{
+		CELL_PHASE_SCOPE(Profile, EPhase::Integrate);
+		RunParallel(static_cast<int32>(mArray.AwakeChunks.size()), integrate_chunk);
+	}
+	else
+	{
+		CELL_PHASE_SCOPE(Profile, EPhase::Integrate);
+		for (int32 k = 0; k < static_cast<int32>(mArray.AwakeChunks.size()); ++k)
+		{
+			integrate_chunk(k);
+		}
+	}
+	// worlds as deep as a power of two split their indices with a shift and a mask
+	if (IsPowerOfTwo(mArray.Size.Y))
+	{
+		Tick(updated, concurrent, DepthShift(mArray.Size));
+	}
+	else
+	{
+		Tick(updated, concurrent, DepthDivide(mArray.Size));
+	}
+
+	{
+		CELL_PHASE_SCOPE(Profile, EPhase::Compact);
+		mArray.CompactActive(Parameters.SortActiveCells);
+		mArray.CollectPrograms();
+	}
+
+	LastUpdated = updated;
+	if (updated < 20)
+	{
+		Repopulate();
+	}
+
+	++StepCount;
+	if (Parameters.ChecksumInterval > 0 && StepCount % Parameters.ChecksumInterval == 0)
+	{
+		CELL_PHASE_SCOPE(Profile, EPhase::Checksum);
+		RollingChecksum = MixChecksum(RollingChecksum ^ GetChecksum());
+		if (Replay)
+		{
+			Replay->Record(StepCount, RollingChecksum);
+		}
+	}
+}
+
+uint64 CellSimulation::GetChecksum() const
+{
+	// a sum of per-cell hashes, so neither the chunk order nor the order inside a chunk matters
+	uint64 sum = 0;
+	for (auto chunk : mArray.AwakeChunks)
+	{
+		for (auto index : mArray.ChunkList[chunk].Active)
+		{
+			uint64 hash = MixChecksum(uint64(index) + 1);
+			hash = MixChecksum(hash ^ (mArray.Program[index] ? mArray.Program[index]->Fingerprint : 0));
+			hash = MixChecksum(hash ^ FloatBits(mArray.Energy[index]) ^ (uint64(FloatBits(mArray.Speed[index].X)) << 32));
+			hash = MixChecksum(hash ^ FloatBits(mArray.Speed[index].Y) ^ (uint64(FloatBits(mArray.accumulated_delta[index].X)) << 32));
+			hash = MixChecksum(hash ^ FloatBits(mArray.accumulated_delta[index].Y) ^ (uint64(mArray.Counter[index]) << 32) ^ (uint64(mArray.Age[index]) << 48));
+			hash = MixChecksum(hash ^ mArray.Fingerprint[index]);
+			hash = MixChecksum(hash ^ (uint64(mArray.Dead[index]) << 16) ^ (uint64(mArray.Rotation[index]) << 24)
+				^ (uint64(mArray.GeneDeviation[index]) << 32) ^ (uint64(mArray.FeedType[index]) << 40));
+			sum += hash;
+		}
+	}
+
+	sum = MixChecksum(sum ^ time_ticks);
+	return MixChecksum(sum ^ RandomDraws ^ (uint64(static_cast<uint32>(Random.GetSeed())) << 32));
+}
+
+template <typename Layout>
+void CellSimulation::Tick(int32 & updated, bool concurrent, const Layout & layout)
+{
+	if (concurrent || Parameters.Deterministic)
+	{
+		TickColored(updated, concurrent, layout);
+	}
+	else
+	{
+		TickSerial(updated, layout);
+	}
+}
+
+template <typename Layout>
+void CellSimulation::TickSerial(int32 & updated, const Layout & layout)
+{
+	// cells born or moved during the pass are collected and wait for the next iteration,
+	// sleeping chunks are not even looked at
+	Activated.clear();
+
+	for (auto chunk : mArray.AwakeChunks)
+	{
+		{
+			CELL_PHASE_SCOPE(Profile, EPhase::Interpret);
+			for (auto index : mArray.ChunkList[chunk].Active)
+			{
+				if (mArray.IsEmpty(index))
+				{
+					continue;
+				}
+
+				const Vec2i pos = layout.ToCell(index);
+				updated += UpdateCell(index, pos, Photo[pos.Y], Chemo[pos.Y], Activated, Stats, Profile);
+			}
+		}
+
+		CELL_PHASE_SCOPE(Profile, EPhase::Resolve);
+		ResolveMoves(mArray, ChunkIntents[chunk], Activated, layout);
+	}
+
+	mArray.AddActive(Activated, layout);
+}
+
+template <typename Layout>
+void CellSimulation::TickColored(int32 & updated, bool concurrent, const Layout & layout)
+{
+	// Awake chunks are colored as a 2x2 checkerboard and one color runs at a time. A cell
+	// touches at most its direct neighbours (gRotations reads, mitosis, ResolveMoves swaps),
+	// so same-colored chunks never share cells while a chunk is at least 2 cells wide and
+	// the chunk count is even along the edges that wrap (see Step). Every chunk has its
+	// own numbers and its activations are filed after the pass, so running the chunks of a
+	// color one after another gives exactly what running them concurrently gives.
+	ChunkActivated.resize(mArray.ChunkList.size());
+	ChunkStats.resize(mArray.ChunkList.size());
+	ChunkProfiles.resize(mArray.ChunkList.size());
+
+	std::vector<int32> tile_updated;
+
+	for (int32 color = 0; color < 4; ++color)
+	{
+		const Vec2i first = { color % 2, color / 2 };
+
+		ColorChunks.clear();
+		for (auto chunk : mArray.AwakeChunks)
+		{
+			if ((chunk / mArray.Chunks.Y) % 2 == first.X && (chunk % mArray.Chunks.Y) % 2 == first.Y)
+			{
+				ColorChunks.push_back(chunk);
+			}
+		}
+
+		const int32 count = static_cast<int32>(ColorChunks.size());
+		tile_updated.assign(count, 0);
+
+		const auto update_chunk = [&](int32 k)
+		{
+			const int32 chunk = ColorChunks[k];
+
+			auto & activated = ChunkActivated[chunk];
+			activated.clear();
+
+			auto & stats = ChunkStats[chunk];
+			stats = PopulationStats();
+
+			auto & profile = ChunkProfiles[chunk];
+			CELL_PROFILE_ONLY(profile.Clear());
+
+			int32 local_updated = 0;
+			{
+				CELL_PHASE_SCOPE(profile, EPhase::Interpret);
+				for (auto index : mArray.ChunkList[chunk].Active)
+				{
+					if (mArray.IsEmpty(index))
+					{
+						continue;
+					}
+
+					const Vec2i pos = layout.ToCell(index);
+					local_updated += UpdateCell(index, pos, Photo[pos.Y], Chemo[pos.Y], activated, stats, profile);
+				}
+			}
+			{
+				CELL_PHASE_SCOPE(profile, EPhase::Resolve);
+				ResolveMoves(mArray, ChunkIntents[chunk], activated, layout);
+			}
+			tile_updated[k] = local_updated;
+		};
+
+		if (concurrent)
+		{
+			RunParallel(count, update_chunk);
+		}
+		else
+		{
+			for (int32 k = 0; k < count; ++k)
+			{
+				update_chunk(k);
+			}
+		}
+
+		for (int32 k = 0; k < count; ++k)
+		{
+			updated += tile_updated[k];
+			Stats.Merge(ChunkStats[ColorChunks[k]]);
+			CELL_PROFILE_ONLY(Profile.Merge(ChunkProfiles[ColorChunks[k]]));
+		}
+	}
+
+	// filed only now, so no chunk list changes while a later color still runs
+	for (auto chunk : mArray.AwakeChunks)
+	{
+		mArray.AddActive(ChunkActivated[chunk], layout);
+	}
+}
+
+int32 CellSimulation::GetTileSize() const
+{
+	const int32 width = mArray.Size.X;
+
+	int32 tile = 2;
+	while (tile < Parameters.TileSize && tile < width / 2)
+	{
+		tile *= 2;
+	}
+	// an even number of tile columns, so the checkerboard also holds across the X wrap,
+	// widths that never allow it keep full chunks and tick serially
+	while (width % 4 == 0 && width % (tile * 2) != 0)
+	{
+		tile /= 2;
+	}
+
+	return tile;
+}
+
+// The cell UpdateCell runs genes for, with one handler per gene. A gene moves the counter
+// itself where it jumps or advances, UpdateCell steps it when it did neither.
+struct CellSimulation::GeneContext
+{
+	using Handler = void (*)(GeneContext & context, const GeneOp & op);
+
+	// by EGene
+	static const std::array<Handler, EGene_MAX> Handlers;
+	// genes that only move the counter
+	static const std::array<bool, EGene_MAX> Control;
+
+	CellSimulation & Simulation;
+	CellRef & Cell;
+	CellRandom & Random;
+	std::vector<int32> & Activated;
+	const int32 Index;
+	const Vec2i Position;
+	const float PhotoEnergy;
+	const float ChemoEnergy;
+	int32 & BornIndex;
+	TickProfile & Profile;
+
+	// the slot the cell faces
+	int32 GetFacing() const
+	{
+		return Simulation.mArray.GetNeighbor(Index, Position, Cell.Rotation);
+	}
+
+	static void Nothing(GeneContext &, const GeneOp &)
+	{}
+
+	static void MoveForward(GeneContext & context, const GeneOp & op)
+	{
+		auto & cell = context.Cell;
+		auto nvec = Vec2f(gRotations[cell.Rotation % 8].X, gRotations[cell.Rotation % 8].Y) * op.Param1 * 10;
+		cell.Speed += nvec;
+		cell.Energy -= nvec.Size();
+		cell.Counter += op.Advance;
+	}
+
+	static void Olding(GeneContext & context, const GeneOp & op)
+	{
+		context.Cell.Age += 10 * op.Param1;
+		context.Cell.Counter += op.Advance;
+	}
+
+	static void Photo(GeneContext & context, const GeneOp & op)
+	{
+		context.Cell.Energy += context.PhotoEnergy;
+		context.Cell.Counter += op.Advance;
+		context.Cell.FeedType = 1;
+	}
+
+	static void Chemo(GeneContext & context, const GeneOp & op)
+	{
+		context.Cell.Energy += context.ChemoEnergy;
+		context.Cell.Counter += op.Advance;
+		context.Cell.FeedType = 2;
+	}
+
+	static void Mitose(GeneContext & context, const GeneOp & op)
+	{
+		auto & cell = context.Cell;
+		auto & world = context.Simulation.mArray;
+		const float ratio = context.Simulation.Parameters.MutationRatio;
+
+		if (cell.Age > 10)
+		{
+			auto n_index = context.GetFacing();
+			if (world.IsEmpty(n_index))
+			{
+				if (cell.Energy > 1)
+				{
+					auto ncell = world[n_index];
+					ncell.SetProgram(cell.Program);
+
+					if (context.Random.RandRange(0, 10 * ratio) == 1)
+					{
+						context.Simulation.Mutate(ncell, true, context.Random);
+						CELL_PROFILE_ONLY(++context.Profile.Mutations);
+					}
+					if (context.Random.RandRange(0, 10 * ratio) == 1)
+					{
+						context.Simulation.Mutate(cell, true, context.Random);
+						CELL_PROFILE_ONLY(++context.Profile.Mutations);
+					}
+					ncell.Rotation = cell.Rotation + op.RawParam1;
+					ncell.Energy = cell.Energy * op.Param2 * 0.5;
+					cell.Energy = cell.Energy * (1 - op.Param2) * 0.5;
+					cell.Age = 0;
+					ncell.Age = 0;
+
+					world.Activate(n_index, context.Activated);
+					context.BornIndex = n_index;
+				}
+			}
+		}
+
+		cell.Counter += op.Advance;
+	}
+
+	static void RotateCW(GeneContext & context, const GeneOp & op)
+	{
+		context.Cell.Rotation += op.Param1 * 360;
+		context.Cell.Energy -= op.Param1 * 0.1;
+
+		context.Cell.Counter += op.Advance;
+	}
+
+	static void RotateCCW(GeneContext & context, const GeneOp & op)
+	{
+		context.Cell.Rotation -= op.Param1 * 360;
+		context.Cell.Energy -= op.Param1 * 0.1;
+
+		context.Cell.Counter += op.Advance;
+	}
+
+	static void GiveEnergy(GeneContext & context, const GeneOp & op)
+	{
+		auto & cell = context.Cell;
+		auto n_index = context.GetFacing();
+		if (!context.Simulation.mArray.IsEmpty(n_index) && n_index != context.Index)
+		{
+			cell.Energy -= cell.Energy * op.Param2;
+			cell.FeedType = 3;
+		}
+
+		cell.Counter += op.Advance;
+	}
+
+	static void Regen(GeneContext & context, const GeneOp & op)
+	{
+		context.Cell.Age *= op.Param1;
+		context.Cell.Energy *= op.Param1;
+
+		context.Cell.Counter += op.Advance;
+	}
+
+	static void TakeEnergy(GeneContext & context, const GeneOp & op)
+	{
+		auto & cell = context.Cell;
+		auto & world = context.Simulation.mArray;
+		auto n_index = context.GetFacing();
+		if (!world.IsEmpty(n_index) && n_index != context.Index)
+		{
+			auto ncell = world[n_index];
+
+			if (!ncell.IsDead())
+			{
+				if (cell.IsFriend(ncell))
+				{
+					cell.Energy += ncell.Energy * op.Param2 * 0.75f;
+					cell.FeedType = 3;
+				}
+				else
+				{
+					cell.Energy += ncell.Energy * op.Param2 * 20.f;
+					cell.FeedType = 4;
+				}
+			}
+			else
+			{
+				cell.Energy += ncell.Energy * op.Param2 * 10.f;
+				cell.FeedType = 5;
+			}
+		}
+
+		cell.Counter += op.Advance;
+	}
+
+	static void DetectFriend(GeneContext & context, const GeneOp & op)
+	{
+		auto & cell = context.Cell;
+		auto & world = context.Simulation.mArray;
+		auto n_index = context.GetFacing();
+		if (!world.IsEmpty(n_index) && n_index != context.Index && world[n_index].IsFriend(cell))
+		{
+			cell.Counter = op.Jump;
+		}
+		else
+		{
+			cell.Counter += op.Advance;
+		}
+	}
+
+	static void Counter(GeneContext & context, const GeneOp & op)
+	{
+		context.Cell.Counter = op.Jump;
+	}
+
+	static void DetectEnergy(GeneContext & context, const GeneOp & op)
+	{
+		if (context.Cell.Energy >= op.Param1 * 100)
+		{
+			context.Cell.Counter = op.Jump;
+		}
+		else
+		{
+			context.Cell.Counter += op.Advance;
+		}
+	}
+
+	// and then goes on like DetectEnergy, as it always did
+	static void Death(GeneContext & context, const GeneOp & op)
+	{
+		context.Cell.MarkDead();
+		DetectEnergy(context, op);
+	}
+};
+
+const std::array<CellSimulation::GeneContext::Handler, EGene_MAX> CellSimulation::GeneContext::Handlers = []()
+{
+	// Trash, MoveBackward and EatForward do nothing
+	std::array<Handler, EGene_MAX> handlers;
+	handlers.fill(&Nothing);
+	handlers[EGene::MoveForward] = &MoveForward;
+	handlers[EGene::RotateCCW] = &RotateCCW;
+	handlers[EGene::RotateCW] = &RotateCW;
+	handlers[EGene::Photo] = &Photo;
+	handlers[EGene::Chemo] = &Chemo;
+	handlers[EGene::Death] = &Death;
+	handlers[EGene::Mitose] = &Mitose;
+	handlers[EGene::GiveEnergy] = &GiveEnergy;
+	handlers[EGene::TakeEnergy] = &TakeEnergy;
+	handlers[EGene::Olding] = &Olding;
+	handlers[EGene::Regen] = &Regen;
+	handlers[EGene::Counter] = &Counter;
+	handlers[EGene::DetectFriend] = &DetectFriend;
+	handlers[EGene::DetectEnergy] = &DetectEnergy;
+	return handlers;
+}();
+
+const std::array<bool, EGene_MAX> CellSimulation::GeneContext::Control = []()
+{
+	std::array<bool, EGene_MAX> control = {};
+	control[EGene::Counter] = true;
+	control[EGene::DetectFriend] = true;
+	control[EGene::DetectEnergy] = true;
+	return control;
+}();
+
+int32 CellSimulation::UpdateCell(int32 self_index, const Vec2i & self_pos, float photoenergy, float chemenergy, std::vector<int32> & activated, PopulationStats & stats, TickProfile & profile)
+{
+	// the slot itself, plus at most a slot a child is born into, empty before
+	const SlotSample before = SampleSlot(mArray, self_index);
+	int32 born_index = -1;
+
+	// numbers of this cell in this step, the same whichever order or thread updates it
+	CellRandom random(Random, StepCount, static_cast<uint32>(self_index));
+
+	auto cell = mArray[self_index];
+	int32 updated = 0;
+
+	// speed and movement are left to IntegrateChunk and ResolveMoves
+	if (!cell.IsDead())
+	{
+		updated = 1;
+
+		GeneContext context = { *this, cell, random, activated, self_index, self_pos, photoenergy, chemenergy, born_index, profile };
+
+		// control genes only move the counter, up to FreeControlGenes of them run on for
+		// free and any other gene ends the turn
+		int32 free_genes = Parameters.FreeControlGenes;
+		const GeneOp * op;
+		do
+		{
+			op = &cell.Program->Ops[cell.Counter % gGenomeSize];
+			const auto oldc = cell.Counter;
+
+#if CELL_PROFILE
+			// one run in GeneSampling is timed, the clock costs about as much as a short gene
+			if (profile.GeneRuns[op->Gene]++ % TickProfile::GeneSampling == 0)
+			{
+				const uint64 start = TickProfile::ReadCycles();
+				GeneContext::Handlers[op->Gene](context, *op);
+				profile.GeneCycles[op->Gene] += TickProfile::ReadCycles() - start;
+				++profile.GeneTimed[op->Gene];
+			}
+			else
+#endif
+			{
+				GeneContext::Handlers[op->Gene](context, *op);
+			}
+
+			if (oldc == cell.Counter)
+			{
+				++cell.Counter;
+			}
+		}
+		while (GeneContext::Control[op->Gene] && free_genes-- > 0);
+
+		if (random.RandRange(0, cell.Age) > 10000)
+		{
+			Mutate(cell, true, random);
+			CELL_PROFILE_ONLY(++profile.Mutations);
+			cell.Age = 0;
+		}
+
+		cell.Age += 1;
+
+		if (cell.Energy > 100 && random.RandHelper(100) == 1)
+		{
+			//cell.Energy = 110;
+			cell.MarkDead();
+			//Mutate(cell, false);
+		}
+
+		cell.Energy -= 0.5f;
+	}
+	else
+	{
+		cell.Energy *= .99f;
+		cell.Energy -= 0.1f;
+	}
+
+	if (cell.Energy < 1)
+	{
+		cell.Kill();
+		cell.Energy = 0;
+	}
+
+	stats.Change(before, SampleSlot(mArray, self_index));
+	if (born_index >= 0)
+	{
+		stats.Change(SlotSample(), SampleSlot(mArray, born_index));
+	}
+
+	return updated;
+}
+
+
+void CellSimulation::Repopulate()
+{
+	CELL_PHASE_SCOPE(Profile, EPhase::Repopulate);
+
+	time_ticks = 0;
+	++Repopulations;
+
+	for (int i = 0; i < mArray.Num(); ++i)
+	{
+		auto cell = mArray[i];
+		cell.Speed = Vec2f(0);
+		cell.Rotation = 0;
+		cell.MarkDead();
+		cell.Age = 0;
+		cell.Energy = -1;
+	}
+
+	mArray.Program.fill(nullptr);
+	mArray.Programs.Reset();
+	mArray.ResetActive();
+	mArray.TouchAll();
+	Stats = PopulationStats();
+
+	std::vector<uint8> ggg;
+	/*0*/ggg.push_back(uint8(EGene::Photo));
+	/*1*/ggg.push_back(uint8(EGene::DetectEnergy));
+	/*2*/ggg.push_back(100);
+	/*3*/ggg.push_back(6);
+	/*4*/ggg.push_back(uint8(EGene::Counter));
+	/*5*/ggg.push_back(0);
+	/*6*/ggg.push_back(uint8(EGene::Mitose));
+	/*7*/ggg.push_back(0);
+	/*8*/ggg.push_back(128);
+	/*0*/ggg.push_back(uint8(EGene::Chemo));
+	/*4*/ggg.push_back(uint8(EGene::Counter));
+	/*5*/ggg.push_back(0);
+
+	// 10000 seeds on the default 256x256 world, the same density on other sizes
+	const int32 seeds = std::max<int32>(1, static_cast<int32>(int64(10000) * mArray.Num() / gDefaultSize.Capacity()));
+	const uint64 stream = gOffStepStream | RandomDraws++;
+
+	std::array<uint32, gSeedNumbers> numbers;
+	for (int32 i = 0; i < seeds; ++i)
+	{
+		Random.Fill(stream, uint64(i) * gSeedNumbers, numbers.data(), gSeedNumbers);
+
+		Cell ncell;
+		ncell.Speed = { CounterRandom::ToFraction(numbers[0]), CounterRandom::ToFraction(numbers[1]) };
+		ncell.Rotation = CounterRandom::ToRange(numbers[2], std::numeric_limits<GeneType>::max());
+		ncell.Energy = CounterRandom::ToFraction(numbers[3]) * 100;
+
+		for (uint32 g = 0; g < gGenomeSize; ++g)
+		{
+			ncell.Genome[g] = CounterRandom::ToRange(numbers[4 + g], std::numeric_limits<GeneType>::max());
+		}
+		ncell.Genome[0] = EGene::Photo;
+		ncell.SetGenome(ncell.Genome);
+
+		/*for (int g = 0; g < ggg.size(); ++g)
+		{
+			ncell.Genome[g] = ggg[g];
+		}*/
+
+		const int32 index = CounterRandom::ToRange(numbers[4 + gGenomeSize], mArray.Num());
+		const SlotSample before = SampleSlot(mArray, index);
+		mArray[index] = ncell;
+		mArray.Activate(index);
+		Stats.Change(before, SampleSlot(mArray, index));
+	}
+}
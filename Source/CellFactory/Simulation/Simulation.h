@@ -0,0 +1,194 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "CellTypes.h"
+#include "CellWorld.h"
+#include "CounterRandom.h"
+#include "PopulationStats.h"
+#include "Profile.h"
+
+#include <future>
+#include <string>
+#include <vector>
+
+struct SimulationParameters
+{
+	float SunMin = 4;
+	float SunMax = 10;
+	float MinMax = 3;
+	float MinMin = 0;
+	float MutationRatio = 1;
+
+	// update the world tile by tile on worker threads instead of one serial sweep
+	bool ParallelTick = false;
+
+	// edge of a world chunk in cells, snapped to a power of two in [2, WorldSize.X / 2]
+	// and shrunk until the chunk columns can be colored for the parallel tick
+	int32 TileSize = 32;
+
+	// keep the active cell list in memory order for locality, costs a sort per iteration
+	bool SortActiveCells = true;
+
+	// cells along X (wrapping) and Y (depth), applied by Reset
+	Vec2i WorldSize = gDefaultSize;
+
+	// let large world columns use huge pages, applied by Reset
+	bool HugePages = true;
+
+	// what lies past the edges of the world
+	ETopology Topology = ETopology::Cylinder;
+
+	// run the serial tick with the colored chunk schedule of the parallel one, so a seed
+	// gives the same world whether ParallelTick is on or not
+	bool Deterministic = false;
+
+	// steps between two world checksums, 0 for none
+	int32 ChecksumInterval = 0;
+
+	// control genes (Counter, DetectFriend, DetectEnergy) a cell runs per step before the
+	// gene that ends its turn, 0 for one gene per step
+	int32 FreeControlGenes = 0;
+};
+
+class CompactWorld;
+class ReplayLog;
+class SimulationRecorder;
+
+// The cell world with its genome interpreter and environment, free of engine types.
+// ACellActor and the command line runner both drive one of these. Every simulation owns
+// its world, so any number of them can run side by side.
+class CellSimulation
+{
+
+public:
+
+	// reseeds the random numbers, resizes the world to Parameters.WorldSize and repopulates it
+	void Reset(int32 seed);
+
+	// what the game runs per frame: iterations steps, then a repopulation if life got sparse
+	void Run(int32 iterations);
+
+	// Run against the clock: steps while the next one is expected to end within
+	// budget_seconds of the call, at least one and at most max_iterations. Returns the steps
+	// it ran. Where a tick ends depends on the machine, so does the repopulation after it.
+	int32 RunBudgeted(double budget_seconds, int32 max_iterations);
+
+	// running estimate of the seconds one step takes, measured by RunBudgeted
+	double GetStepSeconds() const
+	{
+		return StepSeconds;
+	}
+
+	// one iteration over all active cells
+	void Step();
+
+	void Repopulate();
+
+	void Mutate(CellRef cell, bool rehash);
+
+	float GetTime() const;
+	float GetLight(int32 depth) const;
+	float GetChemo(int32 depth) const;
+
+	// Writes the world, its genomes, the random state, the time and the parameters to path
+	// (format in Snapshot.cpp). The state is copied before returning and the file is written
+	// on a thread of its own, the future tells whether that worked.
+	std::future<bool> SaveSnapshot(const std::string & path) const;
+
+	// Replaces the whole state with a snapshot from SaveSnapshot. Returns false and leaves
+	// the simulation untouched if the file is missing, truncated or of another version.
+	bool LoadSnapshot(const std::string & path);
+
+	// Replaces the world with a decoded CompactWorld (in CompactWorld.cpp), everything else
+	// carries on. The decoded world is rounded, replays diverge from here.
+	void LoadCompact(const CompactWorld & compact);
+
+	SimulationParameters Parameters;
+
+	// live cells updated by the last step
+	int32 LastUpdated = 0;
+
+	// live cells updated by the last Run, summed over its steps
+	int32 TickUpdated = 0;
+
+	// kept current by every step, Repopulate and Mutate, free to read between steps
+	PopulationStats Stats;
+
+	// phases and genes of the last Run summed over its steps, all zero without CELL_PROFILE
+	TickProfile Profile;
+
+	// times life died out since Reset and the world was seeded again
+	int32 Repopulations = 0;
+
+	// Hash of every active cell, the time and the random state. Independent of the order
+	// cells are kept in, equal worlds give equal checksums.
+	uint64 GetChecksum() const;
+
+	// steps since Reset, unlike the time it is not restarted by Repopulate
+	uint64 GetStepCount() const
+	{
+		return StepCount;
+	}
+
+	// GetChecksum of every ChecksumInterval-th step folded into the previous value
+	uint64 GetRollingChecksum() const
+	{
+		return RollingChecksum;
+	}
+
+	// receives the rolling checksum whenever it changes, not owned
+	ReplayLog * Replay = nullptr;
+
+	// captures the world at the end of every Run and RunBudgeted, not owned
+	SimulationRecorder * Recorder = nullptr;
+
+	CellWorld mArray;
+
+protected:
+
+	void Mutate(CellRef cell, bool rehash, CellRandom & random);
+
+	// what UpdateCell hands the gene handlers, in Simulation.cpp
+	struct GeneContext;
+
+	int32 UpdateCell(int32 self_index, const Vec2i & self_pos, float photoenergy, float chemenergy, std::vector<int32> & activated, PopulationStats & stats, TickProfile & profile);
+
+	// One pass of UpdateCell over the active cells, serial or by chunk colors on worker
+	// threads when concurrent. Layout (DepthDivide or DepthShift) splits the indices, Step
+	// picks the one the world size allows and each gets a tick of its own.
+	template <typename Layout>
+	void Tick(int32 & updated, bool concurrent, const Layout & layout);
+	template <typename Layout>
+	void TickSerial(int32 & updated, const Layout & layout);
+	template <typename Layout>
+	void TickColored(int32 & updated, bool concurrent, const Layout & layout);
+
+	int32 GetTileSize() const;
+
+	// light and minerals of every depth for the current step
+	std::vector<float> Photo;
+	std::vector<float> Chemo;
+
+	// slots activated during the pass, by chunk for the parallel tick
+	std::vector<int32> Activated;
+	std::vector<std::vector<int32>> ChunkActivated;
+	std::vector<PopulationStats> ChunkStats;
+	std::vector<TickProfile> ChunkProfiles;
+	std::vector<int32> ColorChunks;
+
+	// live cells of every chunk that are to move a slot, by IntegrateChunk
+	std::vector<std::vector<int32>> ChunkIntents;
+
+	// a cell draws from the stream of the step and its index, everything else from the
+	// stream gOffStepStream | RandomDraws
+	CounterRandom Random;
+	uint64 RandomDraws = 0;
+
+	uint64 time_ticks = 0;
+
+	uint64 StepCount = 0;
+	uint64 RollingChecksum = 0;
+
+	double StepSeconds = 0;
+};
@@ -0,0 +1,182 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "SimulationThread.h"
+
+#include <chrono>
+#include <future>
+
+SimulationThread::SimulationThread(CellSimulation & simulation)
+	: Simulation(simulation)
+{}
+
+SimulationThread::~SimulationThread()
+{
+	Stop();
+}
+
+void SimulationThread::Start()
+{
+	if (IsRunning())
+	{
+		return;
+	}
+
+	// readers see the world as it is now until the first tick is published
+	Publish(0);
+	AcquireView();
+
+	Stopping = false;
+	Thread = std::thread([this]() { Loop(); });
+}
+
+void SimulationThread::Stop()
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Stopping = true;
+	}
+	Wake.notify_all();
+	Thread.join();
+
+	// whatever was queued while stopping still runs, nobody waits forever
+	for (auto & command : Commands)
+	{
+		command();
+	}
+	Commands.clear();
+}
+
+void SimulationThread::SetPace(int32 acceleration, float ticks_per_second, double budget_seconds)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	Acceleration = acceleration;
+	TicksPerSecond = ticks_per_second;
+	BudgetSeconds = budget_seconds;
+}
+
+void SimulationThread::SetParameters(const SimulationParameters & parameters)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	Parameters = parameters;
+	ParametersChanged = true;
+}
+
+void SimulationThread::Execute(const std::function<void(CellSimulation &)> & function)
+{
+	if (!IsRunning())
+	{
+		function(Simulation);
+		return;
+	}
+
+	std::promise<void> done;
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Commands.push_back([&]()
+		{
+			function(Simulation);
+			done.set_value();
+		});
+	}
+	Wake.notify_all();
+	done.get_future().wait();
+}
+
+const WorldView & SimulationThread::AcquireView()
+{
+	std::lock_guard<std::mutex> lock(ViewMutex);
+	if (Fresh)
+	{
+		std::swap(Front, Ready);
+		Fresh = false;
+	}
+	return Views[Front];
+}
+
+void SimulationThread::Publish(double tick_seconds)
+{
+	// Back is only ever touched here, on the simulation thread
+	Views[Back].Update(Simulation);
+	Views[Back].TickSeconds = tick_seconds;
+
+	std::lock_guard<std::mutex> lock(ViewMutex);
+	std::swap(Back, Ready);
+	Fresh = true;
+}
+
+void SimulationThread::Loop()
+{
+	using Clock = std::chrono::steady_clock;
+
+	auto next_tick = Clock::now();
+	for (;;)
+	{
+		int32 acceleration;
+		float ticks_per_second;
+		double budget_seconds;
+		std::deque<std::function<void()>> commands;
+		{
+			std::unique_lock<std::mutex> lock(Mutex);
+
+			// sleep until the next tick is due, commands and Stop wake it early
+			Wake.wait_until(lock, next_tick, [this]() { return Stopping || !Commands.empty(); });
+			if (Stopping)
+			{
+				return;
+			}
+
+			commands.swap(Commands);
+			if (ParametersChanged)
+			{
+				const Vec2i size = Simulation.Parameters.WorldSize;
+				const bool huge_pages = Simulation.Parameters.HugePages;
+				Simulation.Parameters = Parameters;
+				Simulation.Parameters.WorldSize = size;
+				Simulation.Parameters.HugePages = huge_pages;
+				ParametersChanged = false;
+			}
+			acceleration = Acceleration;
+			ticks_per_second = TicksPerSecond;
+			budget_seconds = BudgetSeconds;
+		}
+
+		if (!commands.empty())
+		{
+			for (auto & command : commands)
+			{
+				command();
+			}
+			// what the commands changed shows up without waiting for the next tick
+			Publish(LastTickSeconds);
+			continue;
+		}
+
+		const auto start = Clock::now();
+		if (next_tick > start)
+		{
+			continue;
+		}
+
+		if (budget_seconds > 0)
+		{
+			Simulation.RunBudgeted(budget_seconds, acceleration);
+		}
+		else
+		{
+			Simulation.Run(acceleration);
+		}
+		const auto end = Clock::now();
+		LastTickSeconds = std::chrono::duration<double>(end - start).count();
+		Publish(LastTickSeconds);
+
+		// a tick that ran late does not make the following ones hurry to catch up
+		next_tick = ticks_per_second > 0
+			? std::max(next_tick + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / ticks_per_second)), end)
+			: end;
+	}
+}
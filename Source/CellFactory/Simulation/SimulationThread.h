@@ -0,0 +1,86 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "Simulation.h"
+#include "WorldView.h"
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Steps a CellSimulation on a thread of its own at its own pace and publishes it through
+// three WorldViews: one being written, one ready and one being read. Publishing and
+// reading only swap indices, so the simulation never waits for a reader and a reader
+// never waits for a step.
+class SimulationThread
+{
+
+public:
+
+	explicit SimulationThread(CellSimulation & simulation);
+	SimulationThread(const SimulationThread &) = delete;
+	SimulationThread & operator = (const SimulationThread &) = delete;
+
+	~SimulationThread();
+
+	// the simulation is only touched through Execute until Stop returns
+	void Start();
+	void Stop();
+
+	bool IsRunning() const
+	{
+		return Thread.joinable();
+	}
+
+	// Every tick runs acceleration steps, ticks_per_second of them at most (0 for as many
+	// as the thread manages). With a budget_seconds a tick runs the steps that fit in it,
+	// acceleration at most, so a dense world does not hold up parameters and commands.
+	// Parameters are taken over before the next tick, apart from the world size and huge
+	// pages, which only a Reset applies.
+	void SetPace(int32 acceleration, float ticks_per_second, double budget_seconds = 0);
+	void SetParameters(const SimulationParameters & parameters);
+
+	// Runs function on the simulation between two ticks and returns once it did, for
+	// everything that changes the world from outside. Runs it right away when stopped.
+	void Execute(const std::function<void(CellSimulation &)> & function);
+
+	// The latest published view. It stays as it is until the next call, which must come
+	// from the same thread.
+	const WorldView & AcquireView();
+
+private:
+
+	void Loop();
+
+	// copies the simulation into the back view and makes it the ready one
+	void Publish(double tick_seconds);
+
+	CellSimulation & Simulation;
+
+	std::thread Thread;
+
+	// only used on the simulation thread
+	double LastTickSeconds = 0;
+
+	// guards everything below up to the views
+	std::mutex Mutex;
+	std::condition_variable Wake;
+	bool Stopping = false;
+	int32 Acceleration = 25;
+	float TicksPerSecond = 0;
+	double BudgetSeconds = 0;
+	SimulationParameters Parameters;
+	bool ParametersChanged = false;
+	std::deque<std::function<void()>> Commands;
+
+	std::array<WorldView, 3> Views;
+	std::mutex ViewMutex;
+	int32 Back = 0;
+	int32 Ready = 1;
+	int32 Front = 2;
+	bool Fresh = false;
+};
@@ -0,0 +1,564 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Snapshot file, little endian like every platform the game ships on:
+//
+//   header      gSnapshotMagic, version, parameters, world size, random seed, random
+//               draws, time, step count, rolling checksum, genome count, run count,
+//               cell count
+//   genomes     genome count x gGenomeSize bytes, every distinct genome once
+//   runs        run count x (first index, length) of the stored slots, everything else
+//               is blank (CellWorld::IsBlank) and not stored at all
+//   cells       cell count x gCellRecordSize, the cells of the runs in order
+//
+// Empty slots that are not blank are stored too: a cell born there inherits some of what
+// the previous one left, and a loaded world has to continue exactly like the saved one.
+// A cell refers to its genome by position in the genome table, gNoGenome for killed
+// cells and leftovers.
+
+namespace
+{
+	constexpr char gSnapshotMagic[8] = { 'C', 'E', 'L', 'L', 'S', 'N', 'A', 'P' };
+	constexpr uint32 gSnapshotVersion = 1;
+	constexpr uint32 gNoGenome = ~0u;
+
+	constexpr size_t gHeaderSize = 8 + 4 + (5 * 4 + 4 + 4 + 2 * 4 + 3 * 4) + 2 * 4 + 4 + 8 + 8 + 4 + 2 * 8 + 3 * 4;
+	constexpr size_t gRunSize = 2 * 4;
+	constexpr size_t gCellRecordSize = 4 + 4 + 4 * 4 + 2 * 2 + 4 + 8;
+
+	class Writer
+	{
+
+	public:
+
+		explicit Writer(std::vector<uint8> & buffer)
+			: Buffer(buffer)
+		{}
+
+		template <typename T>
+		void Put(const T & value)
+		{
+			PutBytes(&value, sizeof(T));
+		}
+
+		void PutBytes(const void * data, size_t size)
+		{
+			const size_t at = Buffer.size();
+			Buffer.resize(at + size);
+			std::memcpy(Buffer.data() + at, data, size);
+		}
+
+	private:
+
+		std::vector<uint8> & Buffer;
+	};
+
+	// Writer into memory reserved beforehand, for the fixed size cell records
+	class Packer
+	{
+
+	public:
+
+		explicit Packer(uint8 * at)
+			: At(at)
+		{}
+
+		template <typename T>
+		void Put(const T & value)
+		{
+			std::memcpy(At, &value, sizeof(T));
+			At += sizeof(T);
+		}
+
+	private:
+
+		uint8 * At;
+	};
+
+	class Reader
+	{
+
+	public:
+
+		Reader(const uint8 * data, size_t size)
+			: Data(data)
+			, Size(size)
+		{}
+
+		template <typename T>
+		T Get()
+		{
+			T value = {};
+			if (Offset + sizeof(T) <= Size)
+			{
+				std::memcpy(&value, Data + Offset, sizeof(T));
+			}
+			Offset += sizeof(T);
+			return value;
+		}
+
+		// for data whose size was checked up front
+		template <typename T>
+		T GetUnchecked()
+		{
+			T value;
+			std::memcpy(&value, Data + Offset, sizeof(T));
+			Offset += sizeof(T);
+			return value;
+		}
+
+		const uint8 * Skip(size_t size)
+		{
+			const uint8 * at = Data + std::min(Offset, Size);
+			Offset += size;
+			return at;
+		}
+
+		// false once a read went past the end
+		bool IsValid() const
+		{
+			return Offset <= Size;
+		}
+
+		size_t GetRemaining() const
+		{
+			return IsValid() ? Size - Offset : 0;
+		}
+
+	private:
+
+		const uint8 * Data;
+		size_t Size;
+		size_t Offset = 0;
+	};
+
+	// Read-only view of a whole file, mapped so a large snapshot is paged in as it is read
+	// instead of being copied up front.
+	class MappedFile
+	{
+
+	public:
+
+		explicit MappedFile(const std::string & path)
+		{
+#if defined(_WIN32)
+			File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (File == INVALID_HANDLE_VALUE)
+			{
+				return;
+			}
+
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(File, &size) || size.QuadPart == 0)
+			{
+				return;
+			}
+
+			Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!Mapping)
+			{
+				return;
+			}
+
+			Data = static_cast<const uint8 *>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+			Size = Data ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+			const int file = open(path.c_str(), O_RDONLY);
+			if (file < 0)
+			{
+				return;
+			}
+
+			struct stat info;
+			if (fstat(file, &info) == 0 && info.st_size > 0)
+			{
+				void * view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+				if (view != MAP_FAILED)
+				{
+					madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+					Data = static_cast<const uint8 *>(view);
+					Size = static_cast<size_t>(info.st_size);
+				}
+			}
+
+			// the mapping stays valid after the descriptor is closed
+			close(file);
+#endif
+		}
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator = (const MappedFile &) = delete;
+
+		~MappedFile()
+		{
+#if defined(_WIN32)
+			if (Data)
+			{
+				UnmapViewOfFile(Data);
+			}
+			if (Mapping)
+			{
+				CloseHandle(Mapping);
+			}
+			if (File != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(File);
+			}
+#else
+			if (Data)
+			{
+				munmap(const_cast<uint8 *>(Data), Size);
+			}
+#endif
+		}
+
+		const uint8 * Data = nullptr;
+		size_t Size = 0;
+
+	private:
+
+#if defined(_WIN32)
+		HANDLE File = INVALID_HANDLE_VALUE;
+		HANDLE Mapping = nullptr;
+#endif
+	};
+
+	void PutParameters(Writer & out, const SimulationParameters & parameters)
+	{
+		out.Put(parameters.SunMin);
+		out.Put(parameters.SunMax);
+		out.Put(parameters.MinMax);
+		out.Put(parameters.MinMin);
+		out.Put(parameters.MutationRatio);
+		out.Put(uint8(parameters.ParallelTick));
+		out.Put(uint8(parameters.SortActiveCells));
+		out.Put(uint8(parameters.HugePages));
+		out.Put(uint8(parameters.Deterministic));
+		out.Put(parameters.TileSize);
+		out.Put(parameters.WorldSize.X);
+		out.Put(parameters.WorldSize.Y);
+		out.Put(parameters.ChecksumInterval);
+		out.Put(parameters.FreeControlGenes);
+		out.Put(static_cast<uint32>(parameters.Topology));
+	}
+
+	SimulationParameters GetParameters(Reader & in)
+	{
+		SimulationParameters parameters;
+		parameters.SunMin = in.Get<float>();
+		parameters.SunMax = in.Get<float>();
+		parameters.MinMax = in.Get<float>();
+		parameters.MinMin = in.Get<float>();
+		parameters.MutationRatio = in.Get<float>();
+		parameters.ParallelTick = in.Get<uint8>() != 0;
+		parameters.SortActiveCells = in.Get<uint8>() != 0;
+		parameters.HugePages = in.Get<uint8>() != 0;
+		parameters.Deterministic = in.Get<uint8>() != 0;
+		parameters.TileSize = in.Get<int32>();
+		parameters.WorldSize.X = in.Get<int32>();
+		parameters.WorldSize.Y = in.Get<int32>();
+		parameters.ChecksumInterval = in.Get<int32>();
+		parameters.FreeControlGenes = in.Get<int32>();
+		// checked by the caller, an unknown topology fails the load
+		parameters.Topology = static_cast<ETopology>(in.Get<uint32>());
+		return parameters;
+	}
+
+	bool WriteFile(const std::string & path, const std::vector<std::vector<uint8>> & parts)
+	{
+		// written next to the target and moved over it, so a crash never leaves half a snapshot
+		const std::string temporary = path + ".tmp";
+
+		std::FILE * file = std::fopen(temporary.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+
+		bool written = true;
+		for (const auto & part : parts)
+		{
+			written = written && std::fwrite(part.data(), 1, part.size(), file) == part.size();
+		}
+		written = std::fclose(file) == 0 && written;
+
+		if (!written)
+		{
+			std::remove(temporary.c_str());
+			return false;
+		}
+
+#if defined(_WIN32)
+		// rename does not replace an existing file there
+		std::remove(path.c_str());
+#endif
+		return std::rename(temporary.c_str(), path.c_str()) == 0;
+	}
+}
+
+std::future<bool> CellSimulation::SaveSnapshot(const std::string & path) const
+{
+	// Only slots of chunks that ever had a cell are looked at and only the ones that are not
+	// blank get copied, which is all the caller waits for. Programs may be swept once the
+	// simulation moves on, so the genome bytes are copied as well.
+	// header, genomes, runs and cells, handed to the writing thread as they are
+	auto parts = std::make_shared<std::vector<std::vector<uint8>>>(4);
+	auto & genomes = (*parts)[1];
+	std::vector<uint32> runs;
+	auto & cells = (*parts)[3];
+
+	const int32 active = mArray.GetActiveCount();
+	cells.reserve(size_t(active) * gCellRecordSize);
+
+	std::unordered_map<const GenomeProgram *, uint32> genome_ids;
+	genome_ids.reserve(active);
+	const GenomeProgram * last_program = nullptr;
+	uint32 last_genome_id = gNoGenome;
+
+	const int32 edge = mArray.ChunkSize;
+	for (int32 chunk = 0; chunk < mArray.Chunks.Capacity(); ++chunk)
+	{
+		if (!mArray.ChunkList[chunk].Touched)
+		{
+			continue;
+		}
+
+		const Vec2i first = Vec2i(chunk / mArray.Chunks.Y, chunk % mArray.Chunks.Y) * edge;
+		const Vec2i last = { std::min(first.X + edge, mArray.Size.X), std::min(first.Y + edge, mArray.Size.Y) };
+
+		for (int32 x = first.X; x < last.X; ++x)
+		{
+			for (int32 y = first.Y; y < last.Y; ++y)
+			{
+				const int32 index = CellToIndex({ x, y }, mArray.Size);
+				if (mArray.IsBlank(index))
+				{
+					continue;
+				}
+
+				if (!runs.empty() && runs[runs.size() - 2] + runs.back() == static_cast<uint32>(index))
+				{
+					++runs.back();
+				}
+				else
+				{
+					runs.push_back(index);
+					runs.push_back(1);
+				}
+
+				// neighbours are mostly relatives, the last genome saves most map lookups
+				uint32 genome_id = gNoGenome;
+				const GenomeProgram * program = mArray.Program[index];
+				if (program && program == last_program)
+				{
+					genome_id = last_genome_id;
+				}
+				else if (program)
+				{
+					auto found = genome_ids.emplace(program, static_cast<uint32>(genome_ids.size()));
+					if (found.second)
+					{
+						genomes.insert(genomes.end(), program->Genome.begin(), program->Genome.end());
+					}
+					genome_id = found.first->second;
+					last_program = program;
+					last_genome_id = genome_id;
+				}
+
+				const size_t at = cells.size();
+				cells.resize(at + gCellRecordSize);
+				Packer out(cells.data() + at);
+				out.Put(genome_id);
+				out.Put(mArray.Energy[index]);
+				out.Put(mArray.Speed[index].X);
+				out.Put(mArray.Speed[index].Y);
+				out.Put(mArray.accumulated_delta[index].X);
+				out.Put(mArray.accumulated_delta[index].Y);
+				out.Put(mArray.Counter[index]);
+				out.Put(mArray.Age[index]);
+				out.Put(uint8(mArray.Dead[index]));
+				out.Put(mArray.Rotation[index]);
+				out.Put(mArray.GeneDeviation[index]);
+				out.Put(mArray.FeedType[index]);
+				out.Put(mArray.Fingerprint[index]);
+			}
+		}
+	}
+
+	Writer out((*parts)[0]);
+	out.PutBytes(gSnapshotMagic, sizeof(gSnapshotMagic));
+	out.Put(gSnapshotVersion);
+	PutParameters(out, Parameters);
+	out.Put(mArray.Size.X);
+	out.Put(mArray.Size.Y);
+	out.Put(Random.GetSeed());
+	out.Put(RandomDraws);
+	out.Put(time_ticks);
+	out.Put(LastUpdated);
+	out.Put(StepCount);
+	out.Put(RollingChecksum);
+	out.Put(static_cast<uint32>(genome_ids.size()));
+	out.Put(static_cast<uint32>(runs.size() / 2));
+	out.Put(static_cast<uint32>(cells.size() / gCellRecordSize));
+
+	Writer(parts->at(2)).PutBytes(runs.data(), runs.size() * sizeof(uint32));
+
+	return std::async(std::launch::async, [path, parts]()
+	{
+		return WriteFile(path, *parts);
+	});
+}
+
+bool CellSimulation::LoadSnapshot(const std::string & path)
+{
+	MappedFile file(path);
+	if (!file.Data || file.Size < gHeaderSize)
+	{
+		return false;
+	}
+
+	Reader in(file.Data, file.Size);
+	if (std::memcmp(in.Skip(sizeof(gSnapshotMagic)), gSnapshotMagic, sizeof(gSnapshotMagic)) != 0)
+	{
+		return false;
+	}
+
+	if (in.Get<uint32>() != gSnapshotVersion)
+	{
+		return false;
+	}
+
+	const SimulationParameters parameters = GetParameters(in);
+	Vec2i size;
+	size.X = in.Get<int32>();
+	size.Y = in.Get<int32>();
+	const int32 seed = in.Get<int32>();
+	const uint64 random_draws = in.Get<uint64>();
+	const uint64 ticks = in.Get<uint64>();
+	const int32 last_updated = in.Get<int32>();
+	const uint64 steps = in.Get<uint64>();
+	const uint64 rolling_checksum = in.Get<uint64>();
+	const uint32 genome_count = in.Get<uint32>();
+	const uint32 run_count = in.Get<uint32>();
+	const uint32 cell_count = in.Get<uint32>();
+
+	if (size.X < 1 || size.Y < 1 || int64(size.X) * size.Y > std::numeric_limits<int32>::max() || static_cast<uint32>(parameters.Topology) > static_cast<uint32>(ETopology::Box))
+	{
+		return false;
+	}
+	if (in.GetRemaining() != uint64(genome_count) * gGenomeSize + uint64(run_count) * gRunSize + uint64(cell_count) * gCellRecordSize)
+	{
+		return false;
+	}
+
+	const uint8 * genome_data = in.Skip(size_t(genome_count) * gGenomeSize);
+	const uint8 * run_data = in.Skip(size_t(run_count) * gRunSize);
+	const uint8 * cell_data = in.Skip(size_t(cell_count) * gCellRecordSize);
+
+	// every run has to stay inside the world and together they have to cover the cells
+	uint64 covered = 0;
+	Reader runs(run_data, size_t(run_count) * gRunSize);
+	for (uint32 r = 0; r < run_count; ++r)
+	{
+		const uint32 first = runs.Get<uint32>();
+		const uint32 length = runs.Get<uint32>();
+		if (uint64(first) + length > uint64(size.Capacity()))
+		{
+			return false;
+		}
+		covered += length;
+	}
+	if (covered != cell_count)
+	{
+		return false;
+	}
+
+	Parameters = parameters;
+	Parameters.WorldSize = size;
+	Random.Initialize(seed);
+	RandomDraws = random_draws;
+	time_ticks = ticks;
+	LastUpdated = last_updated;
+	TickUpdated = 0;
+	StepCount = steps;
+	RollingChecksum = rolling_checksum;
+	Repopulations = 0;
+
+	mArray.Topology = Parameters.Topology;
+	mArray.Resize(size, Parameters.HugePages);
+	mArray.SetChunkSize(GetTileSize());
+
+	// the columns come zeroed, blank slots only differ in these two
+	mArray.Dead.fill(true);
+	mArray.Energy.fill(-1);
+	mArray.TouchAll();
+
+	std::vector<const GenomeProgram *> programs(genome_count);
+	for (uint32 g = 0; g < genome_count; ++g)
+	{
+		std::array<uint8, gGenomeSize> genome;
+		std::memcpy(genome.data(), genome_data + size_t(g) * gGenomeSize, gGenomeSize);
+		programs[g] = mArray.Programs.Intern(genome);
+	}
+
+	Reader cells(cell_data, size_t(cell_count) * gCellRecordSize);
+	runs = Reader(run_data, size_t(run_count) * gRunSize);
+	for (uint32 r = 0; r < run_count; ++r)
+	{
+		const int32 first = static_cast<int32>(runs.GetUnchecked<uint32>());
+		const int32 length = static_cast<int32>(runs.GetUnchecked<uint32>());
+
+		for (int32 index = first; index < first + length; ++index)
+		{
+			const uint32 genome_id = cells.GetUnchecked<uint32>();
+			mArray.Program[index] = genome_id < genome_count ? programs[genome_id] : nullptr;
+			mArray.Energy[index] = cells.GetUnchecked<float>();
+			mArray.Speed[index].X = cells.GetUnchecked<float>();
+			mArray.Speed[index].Y = cells.GetUnchecked<float>();
+			mArray.accumulated_delta[index].X = cells.GetUnchecked<float>();
+			mArray.accumulated_delta[index].Y = cells.GetUnchecked<float>();
+			mArray.Counter[index] = cells.GetUnchecked<uint16>();
+			mArray.Age[index] = cells.GetUnchecked<uint16>();
+			// a live cell without a genome could not run, it is loaded as a corpse
+			mArray.Dead[index] = cells.GetUnchecked<uint8>() != 0 || !mArray.Program[index];
+			mArray.Rotation[index] = cells.GetUnchecked<RotationType>();
+			mArray.GeneDeviation[index] = cells.GetUnchecked<uint8>();
+			mArray.FeedType[index] = cells.GetUnchecked<uint8>();
+			mArray.Fingerprint[index] = cells.GetUnchecked<uint64>();
+
+			mArray.ChunkList[mArray.GetChunk(index)].Touched = true;
+			if (!mArray.IsEmpty(index))
+			{
+				mArray.Activate(index);
+			}
+		}
+	}
+
+	mArray.CompactActive(Parameters.SortActiveCells);
+	Stats = CountPopulation(mArray);
+
+	return true;
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#include "WorldView.h"
+
+#include <cstring>
+
+void WorldView::Update(const CellSimulation & simulation)
+{
+	const CellWorld & world = simulation.mArray;
+
+	const bool resized = Size != world.Size;
+	if (resized)
+	{
+		Size = world.Size;
+
+		// the view is only read, a world large enough for huge pages gets them here too
+		const int32 count = Size.Capacity();
+		Energy.Allocate(count, simulation.Parameters.HugePages);
+		Dead.Allocate(count, simulation.Parameters.HugePages);
+		FeedType.Allocate(count, simulation.Parameters.HugePages);
+		Fingerprint.Allocate(count, simulation.Parameters.HugePages);
+	}
+
+	const bool full = resized || Generation != world.Generation;
+	const int32 row_length = Size.Y;
+	for (int32 row = 0; row < Size.X; ++row)
+	{
+		if (!full && world.RowStamp[row] <= Stamp)
+		{
+			continue;
+		}
+
+		const int32 first = row * row_length;
+		std::memcpy(&Energy[first], &world.Energy[first], row_length * sizeof(float));
+		std::memcpy(&Dead[first], &world.Dead[first], row_length * sizeof(bool));
+		std::memcpy(&FeedType[first], &world.FeedType[first], row_length * sizeof(uint8));
+		std::memcpy(&Fingerprint[first], &world.Fingerprint[first], row_length * sizeof(uint64));
+	}
+
+	RowStamp = world.RowStamp;
+	Stamp = world.Stamp;
+	Generation = world.Generation;
+
+	Time = simulation.GetTime();
+	Light.resize(Size.Y);
+	Chemo.resize(Size.Y);
+	for (int32 depth = 0; depth < Size.Y; ++depth)
+	{
+		Light[depth] = simulation.GetLight(depth);
+		Chemo[depth] = simulation.GetChemo(depth);
+	}
+
+	Parameters = simulation.Parameters;
+	Stats = simulation.Stats;
+	Profile = simulation.Profile;
+	LastUpdated = simulation.LastUpdated;
+	TickUpdated = simulation.TickUpdated;
+	StepCount = simulation.GetStepCount();
+	RollingChecksum = simulation.GetRollingChecksum();
+}
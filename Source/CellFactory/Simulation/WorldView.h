@@ -0,0 +1,51 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+#pragma once
+
+#include "AlignedArray.h"
+#include "CellTypes.h"
+#include "PopulationStats.h"
+#include "Simulation.h"
+
+#include <vector>
+
+// Read-only copy of what the lenses and the statistics read of a simulation, so they can be
+// read while the simulation steps on. The columns are laid out like the world's.
+class WorldView
+{
+
+public:
+
+	// Brings the copy up to date. Only rows stamped since the previous update are copied,
+	// everything after the world was resized.
+	void Update(const CellSimulation & simulation);
+
+	Vec2i Size = {};
+
+	AlignedArray<float> Energy;
+	AlignedArray<bool> Dead;
+	AlignedArray<uint8> FeedType;
+	AlignedArray<uint64> Fingerprint;
+
+	// as in CellWorld, as of the update
+	std::vector<uint32> RowStamp;
+	uint32 Stamp = 0;
+	uint32 Generation = 0;
+
+	float Time = 0;
+
+	// light and minerals by depth at the time of the update
+	std::vector<float> Light;
+	std::vector<float> Chemo;
+
+	SimulationParameters Parameters;
+	PopulationStats Stats;
+	TickProfile Profile;
+	int32 LastUpdated = 0;
+	int32 TickUpdated = 0;
+	uint64 StepCount = 0;
+	uint64 RollingChecksum = 0;
+
+	// wall time of the last Run
+	double TickSeconds = 0;
+};
@@ -0,0 +1,424 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+// Runs the cell simulation without the engine:
+//   CellRunner [--ticks N] [--seed S] [--acceleration A] [--size XxY] [--parallel] [--tile T]
+//              [--free-genes N] [--topology cylinder|torus|box]
+//              [--load SNAPSHOT] [--save SNAPSHOT]
+//              [--deterministic] [--checksum N] [--replay-log LOG] [--verify REFERENCE_LOG]
+//              [--thread] [--budget MS] [--compact] [--profile]
+//              [--record RECORDING] [--record-every N] [--record-lenses energy,genome,feed]
+// With --thread the world steps on a SimulationThread while the main thread plays the
+// frame loop, drawing the energy lens from the published views at 60 frames per second.
+// With --budget a tick runs the iterations that fit in MS milliseconds, acceleration at
+// most, like ACellActor with a FrameBudgetMs.
+// With --compact the world is packed into a CompactWorld and unpacked again before the
+// run, which then goes on from the rounded world.
+// With --profile the time of every phase and the genes run are printed, summed over the
+// ticks or of the last tick with --thread. Builds without CELL_PROFILE print zeros,
+// it is off unless configured with -DCELL_PROFILE=ON.
+// With --record the lenses are recorded every N ticks by a SimulationRecorder.
+// With --verify the run checks its checksums against the log of an earlier run and
+// exits with 2 at the first step that differs.
+// A tick is what ACellActor does per frame, acceleration iterations of the world.
+
+#include "CompactWorld.h"
+#include "Lenses.h"
+#include "Recorder.h"
+#include "Replay.h"
+#include "Simulation.h"
+#include "SimulationThread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void PrintUsage()
+{
+	std::printf("usage: CellRunner [--ticks N] [--seed S] [--acceleration A] [--size XxY] [--parallel] [--tile T] [--free-genes N] [--topology cylinder|torus|box] [--load SNAPSHOT] [--save SNAPSHOT]\n"
+		"                  [--deterministic] [--checksum N] [--replay-log LOG] [--verify REFERENCE_LOG] [--thread] [--budget MS] [--compact] [--profile]\n"
+		"                  [--record RECORDING] [--record-every N] [--record-lenses energy,genome,feed]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	int32 ticks = 1000;
+	int32 seed = 0;
+	int32 acceleration = 25;
+
+	std::string load_path;
+	std::string save_path;
+	std::string replay_path;
+	std::string reference_path;
+	bool threaded = false;
+	double budget_ms = 0;
+	bool compact = false;
+	bool profile = false;
+	std::string record_path;
+	int32 record_every = 1;
+	uint32 record_lenses = RecordEnergy;
+
+	CellSimulation simulation;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool has_value = i + 1 < argc;
+		if (std::strcmp(argv[i], "--ticks") == 0 && has_value)
+		{
+			ticks = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0 && has_value)
+		{
+			seed = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--acceleration") == 0 && has_value)
+		{
+			acceleration = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--size") == 0 && has_value)
+		{
+			auto & size = simulation.Parameters.WorldSize;
+			if (std::sscanf(argv[++i], "%dx%d", &size.X, &size.Y) != 2)
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (std::strcmp(argv[i], "--tile") == 0 && has_value)
+		{
+			simulation.Parameters.TileSize = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--free-genes") == 0 && has_value)
+		{
+			simulation.Parameters.FreeControlGenes = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--topology") == 0 && has_value)
+		{
+			const char * topology = argv[++i];
+			if (std::strcmp(topology, "cylinder") == 0)
+			{
+				simulation.Parameters.Topology = ETopology::Cylinder;
+			}
+			else if (std::strcmp(topology, "torus") == 0)
+			{
+				simulation.Parameters.Topology = ETopology::Torus;
+			}
+			else if (std::strcmp(topology, "box") == 0)
+			{
+				simulation.Parameters.Topology = ETopology::Box;
+			}
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (std::strcmp(argv[i], "--load") == 0 && has_value)
+		{
+			load_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--save") == 0 && has_value)
+		{
+			save_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--checksum") == 0 && has_value)
+		{
+			simulation.Parameters.ChecksumInterval = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--replay-log") == 0 && has_value)
+		{
+			replay_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--verify") == 0 && has_value)
+		{
+			reference_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--deterministic") == 0)
+		{
+			simulation.Parameters.Deterministic = true;
+		}
+		else if (std::strcmp(argv[i], "--parallel") == 0)
+		{
+			simulation.Parameters.ParallelTick = true;
+		}
+		else if (std::strcmp(argv[i], "--budget") == 0 && has_value)
+		{
+			budget_ms = std::atof(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--compact") == 0)
+		{
+			compact = true;
+		}
+		else if (std::strcmp(argv[i], "--record") == 0 && has_value)
+		{
+			record_path = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--record-every") == 0 && has_value)
+		{
+			record_every = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--record-lenses") == 0 && has_value)
+		{
+			const char * lenses = argv[++i];
+			record_lenses = 0;
+			if (std::strstr(lenses, "energy"))
+			{
+				record_lenses |= RecordEnergy;
+			}
+			if (std::strstr(lenses, "genome"))
+			{
+				record_lenses |= RecordGenome;
+			}
+			if (std::strstr(lenses, "feed"))
+			{
+				record_lenses |= RecordFeed;
+			}
+		}
+		else if (std::strcmp(argv[i], "--profile") == 0)
+		{
+			profile = true;
+		}
+		else if (std::strcmp(argv[i], "--thread") == 0)
+		{
+			threaded = true;
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (load_path.empty())
+	{
+		simulation.Reset(seed);
+	}
+	else
+	{
+		// the snapshot brings its own parameters, the command line ones only apply to a new world
+		const auto load_start = std::chrono::steady_clock::now();
+		if (!simulation.LoadSnapshot(load_path))
+		{
+			std::printf("could not load %s\n", load_path.c_str());
+			return 1;
+		}
+		const double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+		std::printf("loaded %s in %.3f s\n", load_path.c_str(), load_seconds);
+	}
+
+	if (compact)
+	{
+		const auto pack_start = std::chrono::steady_clock::now();
+		CompactWorld packed;
+		if (!packed.Pack(simulation.mArray, simulation.Parameters.HugePages))
+		{
+			std::printf("too many genomes to pack\n");
+			return 1;
+		}
+		const auto pack_end = std::chrono::steady_clock::now();
+		simulation.LoadCompact(packed);
+		const auto unpack_end = std::chrono::steady_clock::now();
+
+		const double cells = simulation.mArray.Num();
+		std::printf("compact %.1f MB (%.2f bytes/cell) against %.1f MB (%.2f bytes/cell), packed in %.3f s, unpacked in %.3f s\n",
+			packed.GetBytes() / 1048576.0, packed.GetBytes() / cells, simulation.mArray.GetColumnBytes() / 1048576.0, simulation.mArray.GetColumnBytes() / cells,
+			std::chrono::duration<double>(pack_end - pack_start).count(), std::chrono::duration<double>(unpack_end - pack_end).count());
+	}
+
+	ReplayLog replay;
+	if (!replay_path.empty() && !replay.Open(replay_path))
+	{
+		std::printf("could not write %s\n", replay_path.c_str());
+		return 1;
+	}
+	if (!reference_path.empty() && !replay.LoadReference(reference_path))
+	{
+		std::printf("could not read %s\n", reference_path.c_str());
+		return 1;
+	}
+	simulation.Replay = &replay;
+
+	SimulationRecorder recorder;
+	if (!record_path.empty())
+	{
+		if (!recorder.Open(record_path, record_lenses, record_every))
+		{
+			std::printf("could not write %s\n", record_path.c_str());
+			return 1;
+		}
+		simulation.Recorder = &recorder;
+	}
+
+	// checksums are taken between steps, --verify without an interval checks every step
+	if (!reference_path.empty() && simulation.Parameters.ChecksumInterval <= 0)
+	{
+		simulation.Parameters.ChecksumInterval = 1;
+	}
+
+	int64 updated = 0;
+	int32 frames = 0;
+	uint32 lense_stamp = 0;
+	double busy_seconds = 0;
+	TickProfile profiled;
+
+	const uint64 first_step = simulation.GetStepCount();
+	const auto start = std::chrono::steady_clock::now();
+	if (threaded)
+	{
+		const uint64 last_step = first_step + uint64(ticks) * acceleration;
+
+		SimulationThread thread(simulation);
+		thread.SetPace(acceleration, 0, budget_ms / 1000);
+		thread.Start();
+
+		std::vector<uint32> pixels;
+		for (;;)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(16667));
+
+			// what a frame of the actor does: take the latest view and redraw its changed rows
+			const WorldView & view = thread.AcquireView();
+			const LenseSource source = GetLenseSource(view);
+			pixels.resize(source.Size.Capacity());
+			for (int32 row = 0; row < source.Size.X; ++row)
+			{
+				if (source.RowStamp[row] > lense_stamp)
+				{
+					FillEnergyPixels(source, row * source.Size.Y, source.Size.Y, pixels.data() + row * source.Size.Y);
+				}
+			}
+			lense_stamp = source.Stamp;
+			++frames;
+
+			if (view.StepCount >= last_step || replay.GetDivergedStep() != 0)
+			{
+				break;
+			}
+		}
+		thread.Stop();
+
+		// the thread may have run a little past the last frame
+		ticks = static_cast<int32>((simulation.GetStepCount() - first_step) / acceleration);
+		profiled = simulation.Profile;
+	}
+	for (int32 tick = 0; !threaded && tick < ticks; ++tick)
+	{
+		const auto tick_start = std::chrono::steady_clock::now();
+		if (budget_ms > 0)
+		{
+			simulation.RunBudgeted(budget_ms / 1000, acceleration);
+		}
+		else
+		{
+			simulation.Run(acceleration);
+		}
+		busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - tick_start).count();
+		updated += simulation.TickUpdated;
+		profiled.Merge(simulation.Profile);
+
+		// nothing after the first difference is worth comparing
+		if (replay.GetDivergedStep() != 0)
+		{
+			ticks = tick + 1;
+			break;
+		}
+	}
+	const auto end = std::chrono::steady_clock::now();
+
+	if (recorder.IsOpen())
+	{
+		// the frames still being written are not part of the run's time
+		recorder.Close();
+		simulation.Recorder = nullptr;
+		std::printf("recorded %d frames to %s, %d dropped\n", recorder.GetFrames(), record_path.c_str(), recorder.GetDropped());
+	}
+
+	const double seconds = std::chrono::duration<double>(end - start).count();
+	const auto & world = simulation.mArray;
+
+	const uint64 iterations = simulation.GetStepCount() - first_step;
+
+	std::printf("world %dx%d, ticks %d, iterations %llu, %.3f s\n", world.Size.X, world.Size.Y, ticks, static_cast<unsigned long long>(iterations), seconds);
+	std::printf("ticks/sec %.2f, iterations/sec %.2f\n", ticks / seconds, iterations / seconds);
+	if (budget_ms > 0 && !threaded)
+	{
+		std::printf("budget %.2f ms, %.1f iterations/tick, %.0f%% of the budget used, %.3f ms/iteration\n", budget_ms, double(iterations) / std::max(ticks, 1),
+			100 * busy_seconds / (std::max(ticks, 1) * budget_ms / 1000), simulation.GetStepSeconds() * 1000);
+	}
+	if (threaded)
+	{
+		std::printf("frames %d, %.2f frames/sec\n", frames, frames / seconds);
+	}
+	std::printf("population %d, active slots %d, awake chunks %d of %d, cell updates %lld\n", world.GetLiveCount(), world.GetActiveCount(), static_cast<int32>(world.AwakeChunks.size()), world.Chunks.Capacity(), static_cast<long long>(updated));
+
+	const auto & stats = simulation.Stats;
+	std::printf("decaying %d, energy %.0f, feed none/photo/chemo/friends/others/corpses %d/%d/%d/%d/%d/%d\n", stats.Decaying, stats.LiveEnergy,
+		stats.Feed[0], stats.Feed[1], stats.Feed[2], stats.Feed[3], stats.Feed[4], stats.Feed[5]);
+
+	std::vector<const GenomeProgram *> top;
+	world.Programs.GetTopSpecies(5, top);
+	std::printf("species %d, largest", stats.Species);
+	for (auto program : top)
+	{
+		std::printf(" %016llx x %d", static_cast<unsigned long long>(program->Fingerprint), program->Population.load());
+	}
+	std::printf("\n");
+
+	if (simulation.Parameters.ChecksumInterval > 0)
+	{
+		std::printf("step %llu, checksum %016llx\n", static_cast<unsigned long long>(simulation.GetStepCount()), static_cast<unsigned long long>(simulation.GetRollingChecksum()));
+	}
+
+	if (profile)
+	{
+		std::printf("phases");
+		for (int32 k = 0; k < TickProfile::Phases; ++k)
+		{
+			std::printf("%s %s %.3f s", k > 0 ? "," : "", TickProfile::GetPhaseName(static_cast<EPhase>(k)), profiled.PhaseSeconds[k]);
+		}
+		std::printf(", mutations %llu\n", static_cast<unsigned long long>(profiled.Mutations));
+
+		double cycles = 0;
+		for (int32 gene = 0; gene < EGene_MAX; ++gene)
+		{
+			cycles += profiled.GetGeneCycles(gene);
+		}
+		std::printf("%-14s %12s %10s %8s\n", "gene", "runs", "cycles/run", "cycles");
+		for (int32 gene = 0; gene < EGene_MAX; ++gene)
+		{
+			const uint64 runs = profiled.GeneRuns[gene];
+			std::printf("%-14s %12llu %10.1f %7.1f%%\n", TickProfile::GetGeneName(gene), static_cast<unsigned long long>(runs),
+				runs > 0 ? profiled.GetGeneCycles(gene) / runs : 0.0, cycles > 0 ? 100 * profiled.GetGeneCycles(gene) / cycles : 0.0);
+		}
+	}
+
+	if (!reference_path.empty())
+	{
+		if (replay.GetDivergedStep() != 0)
+		{
+			std::printf("diverged from %s at step %llu after %d matching checksums\n", reference_path.c_str(), static_cast<unsigned long long>(replay.GetDivergedStep()), replay.GetMatched());
+			return 2;
+		}
+		std::printf("matches %s, %d checksums\n", reference_path.c_str(), replay.GetMatched());
+	}
+
+	if (!save_path.empty())
+	{
+		const auto save_start = std::chrono::steady_clock::now();
+		auto saved = simulation.SaveSnapshot(save_path);
+		const double copy_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - save_start).count();
+		if (!saved.get())
+		{
+			std::printf("could not save %s\n", save_path.c_str());
+			return 1;
+		}
+		const double save_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - save_start).count();
+		std::printf("saved %s in %.3f s, %.3f s of it blocking\n", save_path.c_str(), save_seconds, copy_seconds);
+	}
+
+	return 0;
+}
@@ -0,0 +1,222 @@
+// Copyright (c) 2017 - 2019, Samsonov Andrey. All Rights Reserved.
+
+// Runs an ensemble of worlds over a grid of parameters and writes one result line each:
+//   CellSweep SWEEP RESULTS [--seeds K] [--seed S] [--ticks N] [--acceleration A] [--size XxY]
+// Every line of SWEEP is a parameter set like
+//   SunMin=4 SunMax=6:14:5 MutationRatio=0.5:2:4
+// where a:b:n spreads n values evenly from a to b and a line stands for every combination
+// of its values. Parameters a line leaves out keep their defaults, # starts a comment.
+// Every combination runs with K seeds, S, S + 1, ... RESULTS gets a CSV line per world.
+
+#include "Ensemble.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static void PrintUsage()
+{
+	std::printf("usage: CellSweep SWEEP RESULTS [--seeds K] [--seed S] [--ticks N] [--acceleration A] [--size XxY]\n");
+}
+
+static float * GetField(SimulationParameters & parameters, const std::string & name)
+{
+	if (name == "SunMin") return &parameters.SunMin;
+	if (name == "SunMax") return &parameters.SunMax;
+	if (name == "MinMax") return &parameters.MinMax;
+	if (name == "MinMin") return &parameters.MinMin;
+	if (name == "MutationRatio") return &parameters.MutationRatio;
+	return nullptr;
+}
+
+// adds every parameter set of one sweep line to sets, false if the line does not parse
+static bool ExpandLine(const std::string & line, const SimulationParameters & base, std::vector<SimulationParameters> & sets)
+{
+	std::vector<SimulationParameters> expanded = { base };
+
+	std::istringstream words(line);
+	std::string word;
+	while (words >> word)
+	{
+		const size_t equals = word.find('=');
+		if (equals == std::string::npos)
+		{
+			return false;
+		}
+		const std::string name = word.substr(0, equals);
+		if (!GetField(expanded[0], name))
+		{
+			return false;
+		}
+
+		float from = 0;
+		float to = 0;
+		int count = 1;
+		const char * value = word.c_str() + equals + 1;
+		if (std::sscanf(value, "%f:%f:%d", &from, &to, &count) == 3)
+		{
+			if (count < 1)
+			{
+				return false;
+			}
+		}
+		else if (std::sscanf(value, "%f", &from) == 1)
+		{
+			to = from;
+			count = 1;
+		}
+		else
+		{
+			return false;
+		}
+
+		std::vector<SimulationParameters> combined;
+		for (const auto & set : expanded)
+		{
+			for (int k = 0; k < count; ++k)
+			{
+				SimulationParameters next = set;
+				*GetField(next, name) = count > 1 ? from + (to - from) * k / (count - 1) : from;
+				combined.push_back(next);
+			}
+		}
+		expanded.swap(combined);
+	}
+
+	sets.insert(sets.end(), expanded.begin(), expanded.end());
+	return true;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	const std::string sweep_path = argv[1];
+	const std::string results_path = argv[2];
+
+	int32 seeds = 4;
+	int32 first_seed = 0;
+	int32 ticks = 1000;
+	int32 acceleration = 25;
+	SimulationParameters base;
+
+	for (int i = 3; i < argc; ++i)
+	{
+		const bool has_value = i + 1 < argc;
+		if (std::strcmp(argv[i], "--seeds") == 0 && has_value)
+		{
+			seeds = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0 && has_value)
+		{
+			first_seed = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--ticks") == 0 && has_value)
+		{
+			ticks = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--acceleration") == 0 && has_value)
+		{
+			acceleration = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--size") == 0 && has_value)
+		{
+			if (std::sscanf(argv[++i], "%dx%d", &base.WorldSize.X, &base.WorldSize.Y) != 2)
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	std::ifstream sweep(sweep_path);
+	if (!sweep)
+	{
+		std::printf("could not read %s\n", sweep_path.c_str());
+		return 1;
+	}
+
+	std::vector<SimulationParameters> sets;
+	std::string line;
+	for (int line_number = 1; std::getline(sweep, line); ++line_number)
+	{
+		line = line.substr(0, line.find('#'));
+		if (line.find_first_not_of(" \t\r") == std::string::npos)
+		{
+			continue;
+		}
+		if (!ExpandLine(line, base, sets))
+		{
+			std::printf("%s:%d: expected Name=value or Name=from:to:count\n", sweep_path.c_str(), line_number);
+			return 1;
+		}
+	}
+
+	std::vector<EnsembleRun> runs;
+	for (const auto & set : sets)
+	{
+		for (int32 s = 0; s < seeds; ++s)
+		{
+			EnsembleRun run;
+			run.Parameters = set;
+			run.Seed = first_seed + s;
+			runs.push_back(run);
+		}
+	}
+
+	std::FILE * results = std::fopen(results_path.c_str(), "w");
+	if (!results)
+	{
+		std::printf("could not write %s\n", results_path.c_str());
+		return 1;
+	}
+
+	std::printf("%d parameter sets x %d seeds, %d ticks of %d iterations each\n", static_cast<int32>(sets.size()), seeds, ticks, acceleration);
+
+	std::atomic<int32> finished(0);
+	const int32 total = static_cast<int32>(runs.size());
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto ensemble = RunEnsemble(runs, ticks, acceleration, [&](int32, const EnsembleResult &)
+	{
+		const int32 count = ++finished;
+		if (count % std::max(1, total / 20) == 0 || count == total)
+		{
+			std::printf("%d of %d worlds done\n", count, total);
+			std::fflush(stdout);
+		}
+	});
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::fprintf(results, "world,seed,SunMin,SunMax,MinMax,MinMin,MutationRatio,survival_ticks,extinctions,population,species,energy,"
+		"feed_none,feed_photo,feed_chemo,feed_friends,feed_others,feed_corpses,seconds\n");
+	for (int32 k = 0; k < total; ++k)
+	{
+		const auto & parameters = runs[k].Parameters;
+		const auto & result = ensemble[k];
+		const auto & stats = result.Final;
+		std::fprintf(results, "%d,%d,%g,%g,%g,%g,%g,%d,%d,%d,%d,%.1f,%d,%d,%d,%d,%d,%d,%.3f\n", k, runs[k].Seed,
+			parameters.SunMin, parameters.SunMax, parameters.MinMax, parameters.MinMin, parameters.MutationRatio,
+			result.SurvivalTicks, result.Extinctions, stats.Live, stats.Species, stats.LiveEnergy,
+			stats.Feed[0], stats.Feed[1], stats.Feed[2], stats.Feed[3], stats.Feed[4], stats.Feed[5], result.Seconds);
+	}
+	std::fclose(results);
+
+	std::printf("%d worlds in %.1f s, results in %s\n", total, seconds, results_path.c_str());
+	return 0;
+}